@@ -0,0 +1,68 @@
+#include <iostream>
+#include <chrono>
+#include <climits>
+#include "Bench.h"
+#include "Search.h"
+#include "TTable.h"
+#include "Threads.h"
+
+// A mix of openings, middlegames and endgames
+static const char* BENCH_POSITIONS[] = {
+	"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+	"r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+	"r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+	"rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+	"r1bqkb1r/pppp1ppp/2n2n2/4p3/2B1P3/5N2/PPPP1PPP/RNBQK2R w KQkq - 4 4",
+	"2r3k1/pp3ppp/2n1b3/3p4/3P4/2PB1N2/P4PPP/R5K1 w - - 0 20",
+	"8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+	"8/8/4k3/3p4/3P4/4K3/8/8 w - - 0 1",
+	"6k1/5ppp/8/8/8/8/5PPP/3R2K1 w - - 0 1",
+};
+
+void bench(int depth)
+{
+	Board board;
+	SearchContext context(board);
+
+	// A table of its own, so the node counts don't depend on what was
+	// searched before, and no other search loses its entries.
+	TranspositionTable table;
+	context.table = &table;
+
+	int count = sizeof(BENCH_POSITIONS) / sizeof(BENCH_POSITIONS[0]);
+	u64 total_nodes = 0;
+	double fh = 0, fhf = 0;
+	double eval_hits = 0, eval_misses = 0;
+
+	auto start = std::chrono::steady_clock::now();
+
+	for (int i = 0; i < count; ++i)
+	{
+		std::cout << "Position " << i + 1 << "/" << count << ": " << BENCH_POSITIONS[i] << std::endl;
+
+		board.set_fen(BENCH_POSITIONS[i]);
+		table.clear();
+		context.clear_eval_cache();
+		context.signals.stop = false;
+		context.info.timeset = INT_MAX;
+		context.info.softtime = INT_MAX;
+		context.info.depthset = depth;
+		context.info.nodeset = 0;
+		context.search();
+
+		total_nodes += context.info.nodes;
+		fh += context.info.fh;
+		fhf += context.info.fhf;
+		eval_hits += context.info.eval_hits;
+		eval_misses += context.info.eval_misses;
+	}
+
+	long long ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+
+	std::cout << std::endl
+		<< "Total time (ms) : " << ms << std::endl
+		<< "Nodes searched  : " << total_nodes << std::endl
+		<< "Nodes/second    : " << (ms > 0 ? total_nodes * 1000 / ms : total_nodes) << std::endl
+		<< "First move cuts : " << (fh > 0 ? fhf / fh : 0) << std::endl
+		<< "Eval cache hits : " << (eval_hits + eval_misses > 0 ? eval_hits / (eval_hits + eval_misses) : 0) << std::endl;
+}
@@ -0,0 +1,11 @@
+#include "Board.h"
+#pragma once
+
+// Depth searched by a plain "bench"
+const int BENCH_DEPTH = 10;
+
+// Search each of the built-in bench positions to a fixed depth from a
+// clean state, on a board of its own, and print the total node count,
+// which doubles as a signature of the search, along with the overall
+// speed.
+void bench(int depth);
@@ -0,0 +1,215 @@
+#include "Bitboard.h"
+
+u64 PawnAttacks[2][64];
+u64 KnightAttacks[64];
+u64 KingAttacks[64];
+u64 BetweenBB[64][64];
+u64 LineBB[64][64];
+
+// Ray directions as (row, file) steps. The first four increase the square
+// index as they travel, the last four decrease it.
+enum { DirS, DirE, DirSE, DirSW, DirN, DirW, DirNE, DirNW };
+
+static const int RayRowStep[8] = { 1, 0, 1, 1, -1, 0, -1, -1 };
+static const int RayFileStep[8] = { 0, 1, 1, -1, 0, -1, 1, -1 };
+static const int OppositeDir[8] = { DirN, DirW, DirNW, DirNE, DirS, DirE, DirSW, DirSE };
+
+static u64 Rays[8][64];
+
+S_MAGIC RookMagics[64];
+S_MAGIC BishopMagics[64];
+
+// Every blocker subset of every square, 2^12 entries at most per rook
+// square and 2^9 per bishop square.
+static u64 RookAttackTable[0x19000];
+static u64 BishopAttackTable[0x1480];
+
+static void init_magics(S_MAGIC magics[64], u64* table, u64 (*slow_attacks)(int, u64));
+static u64 slow_rook_attacks(int sq, u64 occupied);
+static u64 slow_bishop_attacks(int sq, u64 occupied);
+
+static bool initialised = false;
+
+// Set the bit for (row, file) if it lies on the board.
+static u64 square_bb(int row, int file)
+{
+	if (row < 0 || row > 7 || file < 0 || file > 7) return 0ULL;
+	return BIT(row * 8 + file);
+}
+
+void init_bitboards()
+{
+	if (initialised) return;
+
+	for (int sq = 0; sq < 64; ++sq)
+	{
+		int row = ROW_OF(sq);
+		int file = FILE_OF(sq);
+
+		PawnAttacks[0][sq] = square_bb(row - 1, file - 1) | square_bb(row - 1, file + 1);
+		PawnAttacks[1][sq] = square_bb(row + 1, file - 1) | square_bb(row + 1, file + 1);
+
+		KnightAttacks[sq] =
+			square_bb(row - 2, file + 1) | square_bb(row - 2, file - 1) |
+			square_bb(row + 2, file + 1) | square_bb(row + 2, file - 1) |
+			square_bb(row - 1, file + 2) | square_bb(row - 1, file - 2) |
+			square_bb(row + 1, file + 2) | square_bb(row + 1, file - 2);
+
+		KingAttacks[sq] = 0ULL;
+		for (int dr = -1; dr <= 1; ++dr)
+			for (int df = -1; df <= 1; ++df)
+				if (dr != 0 || df != 0) KingAttacks[sq] |= square_bb(row + dr, file + df);
+
+		for (int dir = 0; dir < 8; ++dir)
+		{
+			Rays[dir][sq] = 0ULL;
+			for (int r = row + RayRowStep[dir], f = file + RayFileStep[dir];
+				r >= 0 && r <= 7 && f >= 0 && f <= 7;
+				r += RayRowStep[dir], f += RayFileStep[dir])
+			{
+				Rays[dir][sq] |= BIT(r * 8 + f);
+			}
+		}
+	}
+
+	for (int a = 0; a < 64; ++a)
+	{
+		for (int b = 0; b < 64; ++b) BetweenBB[a][b] = LineBB[a][b] = 0ULL;
+
+		for (int dir = 0; dir < 8; ++dir)
+		{
+			u64 line = Rays[dir][a] | Rays[OppositeDir[dir]][a] | BIT(a);
+			u64 ray = Rays[dir][a];
+			while (ray)
+			{
+				int b = pop_lsb(ray);
+				BetweenBB[a][b] = Rays[dir][a] ^ Rays[dir][b] ^ BIT(b);
+				LineBB[a][b] = line;
+			}
+		}
+	}
+
+	init_magics(RookMagics, RookAttackTable, slow_rook_attacks);
+	init_magics(BishopMagics, BishopAttackTable, slow_bishop_attacks);
+
+	initialised = true;
+}
+
+// Attacks along a single ray, stopping at (and including) the first
+// occupied square.
+static u64 ray_attacks(int dir, int sq, u64 occupied)
+{
+	u64 attacks = Rays[dir][sq];
+	u64 blockers = attacks & occupied;
+	if (blockers)
+	{
+		int blocker = dir < DirN ? lsb(blockers) : msb(blockers);
+		attacks ^= Rays[dir][blocker];
+	}
+	return attacks;
+}
+
+// Slow ray walks, only used to fill the lookup tables
+static u64 slow_rook_attacks(int sq, u64 occupied)
+{
+	return ray_attacks(DirN, sq, occupied) | ray_attacks(DirE, sq, occupied) |
+		ray_attacks(DirS, sq, occupied) | ray_attacks(DirW, sq, occupied);
+}
+
+static u64 slow_bishop_attacks(int sq, u64 occupied)
+{
+	return ray_attacks(DirNE, sq, occupied) | ray_attacks(DirSE, sq, occupied) |
+		ray_attacks(DirSW, sq, occupied) | ray_attacks(DirNW, sq, occupied);
+}
+
+// xorshift64* generator, reseeded for each row so the magics found (and
+// the startup time spent finding them) are the same on every run. The
+// seeds were picked to keep the search short.
+static u64 prng_state;
+static const u64 MagicSeeds[8] = { 1776, 826, 3907, 2205, 739, 2078, 3582, 30 };
+
+static u64 prng_next()
+{
+	prng_state ^= prng_state >> 12;
+	prng_state ^= prng_state << 25;
+	prng_state ^= prng_state >> 27;
+	return prng_state * 2685821657736338717ULL;
+}
+
+// Magic candidates with few set bits tend to work best
+static u64 sparse_random()
+{
+	return prng_next() & prng_next() & prng_next();
+}
+
+// Fill the attack table for every square of one slider type. Without PEXT
+// a magic is searched for each square that maps every blocker subset to a
+// slot holding the right attacks.
+static void init_magics(S_MAGIC magics[64], u64* table, u64 (*slow_attacks)(int, u64))
+{
+	static u64 occupancy[4096];
+	static u64 reference[4096];
+	static int epoch[4096];
+	int current = 0;
+
+	const u64 rows_18 = 0xffULL | (0xffULL << 56);
+	const u64 files_ah = FileABB | FileHBB;
+
+	u64* next_table = table;
+
+	for (int sq = 0; sq < 64; ++sq)
+	{
+		S_MAGIC& m = magics[sq];
+		if (FILE_OF(sq) == 0) prng_state = MagicSeeds[ROW_OF(sq)];
+
+		// Edge squares never change the attack set unless the slider sits
+		// on that edge itself.
+		u64 edges = (rows_18 & ~(0xffULL << (ROW_OF(sq) * 8))) | (files_ah & ~(FileABB << FILE_OF(sq)));
+		m.mask = slow_attacks(sq, 0ULL) & ~edges;
+		m.shift = 64 - pop_count(m.mask);
+		m.attacks = next_table;
+
+		// Enumerate every subset of the mask (Carry-Rippler)
+		int size = 0;
+		u64 b = 0ULL;
+		do
+		{
+			occupancy[size] = b;
+			reference[size] = slow_attacks(sq, b);
+#ifdef USE_PEXT
+			m.attacks[_pext_u64(b, m.mask)] = reference[size];
+#endif
+			++size;
+			b = (b - m.mask) & m.mask;
+		} while (b);
+
+		next_table += size;
+
+#ifndef USE_PEXT
+		for (int i = 0; i < size; )
+		{
+			do
+			{
+				m.magic = sparse_random();
+			} while (pop_count((m.mask * m.magic) >> 56) < 6);
+
+			// A slot may be shared by subsets with the same attacks; epoch
+			// marks which slots were written during this attempt.
+			++current;
+			for (i = 0; i < size; ++i)
+			{
+				unsigned idx = magic_index(m, occupancy[i]);
+				if (epoch[idx] < current)
+				{
+					epoch[idx] = current;
+					m.attacks[idx] = reference[i];
+				}
+				else if (m.attacks[idx] != reference[i])
+				{
+					break;
+				}
+			}
+		}
+#endif
+	}
+}
@@ -0,0 +1,128 @@
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// Slider attacks are indexed with PEXT when the compiler targets BMI2, or
+// when USE_PEXT is defined explicitly (MSVC has no BMI2 macro).
+#if defined(__BMI2__) && !defined(USE_PEXT)
+#define USE_PEXT
+#endif
+
+#ifdef USE_PEXT
+#include <immintrin.h>
+#endif
+#pragma once
+
+typedef unsigned long long u64;
+
+// Squares are numbered 0..63 starting at a8 and running along each rank
+// towards h1, so index = row * 8 + file where row 0 is the eighth rank.
+#define FILE_OF(sq) ((sq) & 7)
+#define ROW_OF(sq) ((sq) >> 3)
+#define BIT(sq) (1ULL << (sq))
+
+const u64 FileABB = 0x0101010101010101ULL;
+const u64 FileHBB = FileABB << 7;
+const u64 Row2BB = 0xffULL << 48; // White pawn starting rank
+const u64 Row7BB = 0xffULL << 8;  // Black pawn starting rank
+
+// Leaper attacks, indexed by square. PawnAttacks holds the squares a pawn
+// of the given colour on that square attacks.
+extern u64 PawnAttacks[2][64];
+extern u64 KnightAttacks[64];
+extern u64 KingAttacks[64];
+
+// BetweenBB holds the squares strictly between two squares sharing a rank,
+// file or diagonal, LineBB the whole line through them. Both are empty for
+// unaligned squares.
+extern u64 BetweenBB[64][64];
+extern u64 LineBB[64][64];
+
+void init_bitboards();
+
+// Sliding attacks are looked up in precomputed tables: the relevant
+// blockers are masked out of the occupancy and turned into a table index,
+// by magic multiplication or by PEXT.
+typedef struct {
+    u64 mask;
+    u64 magic;
+    u64* attacks;
+    int shift;
+} S_MAGIC;
+
+extern S_MAGIC RookMagics[64];
+extern S_MAGIC BishopMagics[64];
+
+inline unsigned magic_index(const S_MAGIC& m, u64 occupied)
+{
+#ifdef USE_PEXT
+	return (unsigned)_pext_u64(occupied, m.mask);
+#else
+	return (unsigned)(((occupied & m.mask) * m.magic) >> m.shift);
+#endif
+}
+
+inline u64 rook_attacks(int sq, u64 occupied)
+{
+	return RookMagics[sq].attacks[magic_index(RookMagics[sq], occupied)];
+}
+
+inline u64 bishop_attacks(int sq, u64 occupied)
+{
+	return BishopMagics[sq].attacks[magic_index(BishopMagics[sq], occupied)];
+}
+
+// The 64-bit MSVC intrinsics only exist on x64, 32-bit builds work on the
+// two halves of the bitboard.
+inline int pop_count(u64 bb)
+{
+#if defined(_MSC_VER) && defined(_M_X64)
+	return (int)__popcnt64(bb);
+#elif defined(_MSC_VER)
+	return (int)(__popcnt((unsigned)bb) + __popcnt((unsigned)(bb >> 32)));
+#else
+	return __builtin_popcountll(bb);
+#endif
+}
+
+// Index of the least significant set bit. bb must not be empty.
+inline int lsb(u64 bb)
+{
+#if defined(_MSC_VER) && defined(_M_X64)
+	unsigned long index;
+	_BitScanForward64(&index, bb);
+	return (int)index;
+#elif defined(_MSC_VER)
+	unsigned long index;
+	if (_BitScanForward(&index, (unsigned long)bb)) return (int)index;
+	_BitScanForward(&index, (unsigned long)(bb >> 32));
+	return (int)index + 32;
+#else
+	return __builtin_ctzll(bb);
+#endif
+}
+
+// Index of the most significant set bit. bb must not be empty.
+inline int msb(u64 bb)
+{
+#if defined(_MSC_VER) && defined(_M_X64)
+	unsigned long index;
+	_BitScanReverse64(&index, bb);
+	return (int)index;
+#elif defined(_MSC_VER)
+	unsigned long index;
+	if (_BitScanReverse(&index, (unsigned long)(bb >> 32))) return (int)index + 32;
+	_BitScanReverse(&index, (unsigned long)bb);
+	return (int)index;
+#else
+	return 63 ^ __builtin_clzll(bb);
+#endif
+}
+
+// Remove the least significant set bit from bb and return its index.
+inline int pop_lsb(u64& bb)
+{
+	int sq = lsb(bb);
+	bb &= bb - 1;
+	return sq;
+}
@@ -2,30 +2,111 @@
 #include <vector>
 #include <iostream>
 #include <assert.h>
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
 #include <algorithm>
+#include <mutex>
 #include "Utils.h"
 #include "Board.h"
+#include "Nnue.h"
+
+u64 Board::piece_keys[12][64];
+u64 Board::turn_key;
+u64 Board::castle_keys[16];
+u64 Board::en_pas_keys[64];
+int Board::mvv_lva_scores[13][13];
+
+// Castling rights that survive a move touching each square; moving a king
+// or rook, or capturing a rook, clears the matching rights.
+static const int CastlePerm[64] = {
+	15 & ~BlackQueenSide, 15, 15, 15, 15 & ~(BlackKingSide | BlackQueenSide), 15, 15, 15 & ~BlackKingSide,
+	15, 15, 15, 15, 15, 15, 15, 15,
+	15, 15, 15, 15, 15, 15, 15, 15,
+	15, 15, 15, 15, 15, 15, 15, 15,
+	15, 15, 15, 15, 15, 15, 15, 15,
+	15, 15, 15, 15, 15, 15, 15, 15,
+	15, 15, 15, 15, 15, 15, 15, 15,
+	15 & ~WhiteQueenSide, 15, 15, 15, 15 & ~(WhiteKingSide | WhiteQueenSide), 15, 15, 15 & ~WhiteKingSide,
+};
 
 Board::Board()
 {
-	init_hash_keys();
-	init_pv_table();
-	init_mvv_lva();
-	move_history = std::vector<int>();
-	squares = std::vector<int>(128, OffBoard);
+	init_tables();
+	hisPly = 0;
+	pawn_table.resize(PAWN_TABLE_ENTRIES);
 	clear_board();
 }
 
-Board::~Board() {
-	free(pv_table->p_table);
-}
-
-// Reset board state such that on-board squares are marked empty,
-// and offboard squares marked offboard.
+// Reset board state such that every square is marked empty.
 void Board::clear_board() {
-	for (int i = 0; i < 128; ++i) {
-		if ((i & 0x88) == 0) squares[i] = Empty;
+	for (int i = 0; i < 64; ++i) squares[i] = Empty;
+	for (int piece = WhitePawn; piece <= BlackKing; ++piece)
+	{
+		pieces[piece] = 0ULL;
+		piece_count[piece] = 0;
 	}
+	occupancy[White] = occupancy[Black] = 0ULL;
+	occupied = 0ULL;
+	castling = 0;
+	en_pas = NO_SQUARE;
+	fifty_move = 0;
+	pos_key = 0ULL;
+	pawn_key = 0ULL;
+	psq_score = 0;
+	phase = 0;
+	accumulator = NULL;
+}
+
+// Place a piece on an empty square, keeping the bitboards in step.
+void Board::add_piece(int piece, int sq) {
+	squares[sq] = piece;
+	pos_key ^= piece_keys[piece][sq];
+	if (piece == WhitePawn || piece == BlackPawn) pawn_key ^= piece_keys[piece][sq];
+	psq_score += psq_table[piece][sq];
+	phase += PHASE_WEIGHT[piece];
+	if (accumulator) nnue_add(*accumulator, piece, sq);
+	list_index[sq] = piece_count[piece];
+	piece_list[piece][piece_count[piece]++] = sq;
+	pieces[piece] |= BIT(sq);
+	occupancy[get_color(piece)] |= BIT(sq);
+	occupied |= BIT(sq);
+}
+
+void Board::remove_piece(int sq) {
+	int piece = squares[sq];
+	squares[sq] = Empty;
+	pos_key ^= piece_keys[piece][sq];
+	if (piece == WhitePawn || piece == BlackPawn) pawn_key ^= piece_keys[piece][sq];
+	psq_score -= psq_table[piece][sq];
+	phase -= PHASE_WEIGHT[piece];
+	if (accumulator) nnue_remove(*accumulator, piece, sq);
+
+	// Fill the hole with the last square in the list
+	int last = piece_list[piece][--piece_count[piece]];
+	piece_list[piece][list_index[sq]] = last;
+	list_index[last] = list_index[sq];
+
+	pieces[piece] &= ~BIT(sq);
+	occupancy[get_color(piece)] &= ~BIT(sq);
+	occupied &= ~BIT(sq);
+}
+
+// Move a piece to an empty square.
+void Board::move_piece(int from, int to) {
+	int piece = squares[from];
+	u64 from_to = BIT(from) | BIT(to);
+	squares[from] = Empty;
+	squares[to] = piece;
+	pos_key ^= piece_keys[piece][from] ^ piece_keys[piece][to];
+	if (piece == WhitePawn || piece == BlackPawn) pawn_key ^= piece_keys[piece][from] ^ piece_keys[piece][to];
+	psq_score += psq_table[piece][to] - psq_table[piece][from];
+	if (accumulator) nnue_move(*accumulator, piece, from, to);
+	list_index[to] = list_index[from];
+	piece_list[piece][list_index[to]] = to;
+	pieces[piece] ^= from_to;
+	occupancy[get_color(piece)] ^= from_to;
+	occupied ^= from_to;
 }
 
 // Set the board position using a FEN string
@@ -41,85 +122,58 @@ void Board::set_fen(std::string fen)
 	}
 
 	int index = 0;
-	for (char piece : split_fen[0])
+	for (char c : split_fen[0])
 	{
-		switch (piece)
+		if (c >= '1' && c <= '8')
 		{
-		case 'R':
-			squares[index] = WhiteRook;
-			break;
-		case 'N':
-			squares[index] = WhiteKnight;
-			break;
-		case 'B':
-			squares[index] = WhiteBishop;
-			break;
-		case 'Q':
-			squares[index] = WhiteQueen;
-			break;
-		case 'K':
-			squares[index] = WhiteKing;
-			white_king_position = index;
-			break;
-		case 'P':
-			squares[index] = WhitePawn;
-			break;
-
-		case 'r':
-			squares[index] = BlackRook;
-			break;
-		case 'n':
-			squares[index] = BlackKnight;
-			break;
-		case 'b':
-			squares[index] = BlackBishop;
-			break;
-		case 'q':
-			squares[index] = BlackQueen;
-			break;
-		case 'k':
-			squares[index] = BlackKing;
-			black_king_position = index;
-			break;
-		case 'p':
-			squares[index] = BlackPawn;
-			break;
-
-		case '/':
-			index += 7;
-			break;
-		case '2':
-			++index;
-			break;
-		case '3':
-			index += 2;
-			break;
-		case '4':
-			index += 3;
-			break;
-		case '5':
-			index += 4;
-			break;
-		case '6':
-			index += 5;
-			break;
-		case '7':
-			index += 6;
-			break;
-		case '8':
-			index += 7;
-			break;
+			index += c - '0';
+			continue;
 		}
+
+		size_t piece = PIECE_CHAR_MAP.find(c);
+		if (piece > BlackKing || index > 63) continue;
+
+		add_piece((int)piece, index);
 		++index;
 	}
 
-	// TODO: Implement complete FEN parser
-	castling = split_fen[2];
-	en_pas = split_fen[3];
-	// fen_half_moves = split_fen[4]
+	int rights = 0;
+	for (char c : split_fen[2])
+	{
+		if (c == 'K') rights |= WhiteKingSide;
+		if (c == 'Q') rights |= WhiteQueenSide;
+		if (c == 'k') rights |= BlackKingSide;
+		if (c == 'q') rights |= BlackQueenSide;
+	}
+	set_castling(rights);
+
+	if (split_fen[3].size() == 2)
+	{
+		set_en_pas((split_fen[3][0] - 'a') + 8 * ('8' - split_fen[3][1]));
+	}
+
+	fifty_move = isdigit(split_fen[4][0]) ? std::stoi(split_fen[4]) : 0;
 	// fen_ply = split_fen[5]
 
-	turn = split_fen[1] == "b" ? Black : White;
+	turn = White;
+	if (split_fen[1] == "b") switch_turn();
+
+	hisPly = 0;
+	refresh_accumulator();
+	assert(pos_key == generate_position_key());
+	assert(pawn_key == generate_pawn_key());
+	assert(psq_score == generate_psq_score());
+}
+
+void Board::set_castling(int rights) {
+	pos_key ^= castle_keys[castling] ^ castle_keys[rights];
+	castling = rights;
+}
+
+void Board::set_en_pas(int sq) {
+	if (en_pas != NO_SQUARE) pos_key ^= en_pas_keys[en_pas];
+	en_pas = sq;
+	if (en_pas != NO_SQUARE) pos_key ^= en_pas_keys[en_pas];
 }
 
 //
@@ -136,52 +190,34 @@ void Board::set_fen(std::string fen)
 //
 void Board::draw()
 {
-	int index = 0;
-	for (int i = 0; i < squares.size(); ++i)
+	for (int i = 0; i < 64; ++i)
 	{
-		if (index == 8)
-		{
-			std::cout << std::endl;
-			index = 0;
-		}
-
-		if ((i & 0x88) == 0)
-		{
-			printf("%2c", PIECE_CHAR_MAP[squares[i]]);
-			++index;
-		}
+		if (i != 0 && FILE_OF(i) == 0) std::cout << std::endl;
+		printf("%2c", PIECE_CHAR_MAP[squares[i]]);
 	}
 
-	printf("\n");
+	printf("\n\n");
 
-	for (int i = 0; i < squares.size(); ++i)
+	for (int i = 0; i < 64; ++i)
 	{
-		if (index == 8)
-		{
-			std::cout << std::endl;
-			index = 0;
-		}
-
-		if ((i & 0x88) == 0)
-		{
-			printf("%2c", is_square_attacked(i, White) ? '*' : '-');
-			++index;
-		}
+		if (i != 0 && FILE_OF(i) == 0) std::cout << std::endl;
+		printf("%2c", is_square_attacked(i, White) ? '*' : '-');
 	}
 
 	std::cout << std::endl <<
 		"turn: " << "WB "[turn] << std::endl;
 
-	int w_king_position = std::find(squares.begin(), squares.end(), WhiteKing) - squares.begin();
-	int b_king_position = std::find(squares.begin(), squares.end(), BlackKing) - squares.begin();
+	int w_king_position = king_square(White);
+	int b_king_position = king_square(Black);
 
 	std::cout << "white in check: " << is_square_attacked(w_king_position, Black) << " " << get_ref(w_king_position) << std::endl;
 	std::cout << "black in check: " << is_square_attacked(b_king_position, White) << " " << get_ref(b_king_position) << std::endl;
 	std::cout << "score: " << get_score() << std::endl;
-	printf("%X\n", position_key());
+	printf("%llX\n", position_key());
 }
 
 int Board::switch_turn() {
+	pos_key ^= turn_key;
 	return turn ^= 1;
 }
 
@@ -197,193 +233,308 @@ int Board::get_color(int piece) {
 }
 
 std::string Board::get_ref(int position) {
-	return "abcdefgh"[position % 8] + std::to_string((int)(8 - floor(position / 16)));
+	return "abcdefgh"[FILE_OF(position)] + std::to_string(8 - ROW_OF(position));
 }
 
 std::string Board::get_move_ref(int move) {
-	return get_ref((move >> 20) & 0xff) + get_ref((move >> 12) & 0xff);
+	std::string ref = get_ref(FROM_SQ(move)) + get_ref(TO_SQ(move));
+	if (PROMOTED_PIECE(move) != WhitePawn) ref += "pnbrqk"[PROMOTED_PIECE(move) % 6];
+	return ref;
 }
 
 void Board::make_move(int move) {
-	int result_piece = (move >> 8) & 0xf;
+	int from = FROM_SQ(move);
+	int to = TO_SQ(move);
+	int piece = MOVED_PIECE(move);
+	int captured = CAPTURED_PIECE(move);
+	int flag = MOVE_FLAG(move);
+	int promoted = PROMOTED_PIECE(move);
+
+	assert(hisPly < MAX_GAME_MOVES);
+	move_history[hisPly++] = { move, castling, en_pas, fifty_move, pos_key };
+
+	// The new ply's accumulator starts as a copy of the last one and is
+	// brought up to date by the piece updates below.
+	if (accumulator)
+	{
+		accumulator_stack[hisPly] = *accumulator;
+		accumulator = &accumulator_stack[hisPly];
+	}
 
-	// bool is_white_promotion = result_piece == WhitePawn && floor(((move >> 12) & 0xff) / 16) == 0;
-	// bool is_black_promotion = result_piece == BlackPawn && floor(((move >> 12) & 0xff) / 16) == 7;
+	// An en passant capture takes the pawn beside the destination square
+	if (flag == FLAG_EN_PASSANT) remove_piece(to + (turn == White ? 8 : -8));
+	else if (captured != Empty) remove_piece(to);
 
-	// if (is_white_promotion) result_piece = WhiteQueen;
-	// else if (is_black_promotion) result_piece = BlackQueen;
+	move_piece(from, to);
 
-	move_history.push_back(move);
-	squares[(move >> 12) & 0xff] = result_piece;
-	squares[(move >> 20) & 0xff] = Empty;
-	switch_turn();
+	if (promoted != WhitePawn)
+	{
+		remove_piece(to);
+		add_piece(promoted, to);
+	}
 
-	if (((move >> 8) & 0xf) == WhiteKing)
+	// The rook jumps over the king: h-file to f-file or a-file to d-file
+	if (flag == FLAG_CASTLE)
 	{
-		white_king_position = (move >> 12) & 0xff;
+		if (to > from) move_piece(from + 3, from + 1);
+		else move_piece(from - 4, from - 1);
 	}
 
-	else if (((move >> 8) & 0xf) == BlackKing)
+	if (piece == WhitePawn || piece == BlackPawn || captured != Empty) fifty_move = 0;
+	else ++fifty_move;
+
+	set_castling(castling & CastlePerm[from] & CastlePerm[to]);
+
+	// Only record the en passant square when an enemy pawn can use it, so
+	// positions that differ in name only share a key.
+	int ep = NO_SQUARE;
+	if (flag == FLAG_DOUBLE_PUSH)
 	{
-		black_king_position = (move >> 12) & 0xff;
+		int enemy_pawn = piece == WhitePawn ? BlackPawn : WhitePawn;
+		if (PawnAttacks[turn][(from + to) / 2] & pieces[enemy_pawn]) ep = (from + to) / 2;
 	}
+	set_en_pas(ep);
+
+	switch_turn();
 
-	// ply++;
+	assert(pos_key == generate_position_key());
+	assert(pawn_key == generate_pawn_key());
+	assert(psq_score == generate_psq_score());
+	assert(accumulator_matches());
 }
 
 void Board::undo_last_move() {
-	int last_move = move_history[move_history.size() - 1];
-	squares[(last_move >> 20) & 0xff] = (last_move >> 8) & 0xf;
-	squares[(last_move >> 12) & 0xff] = (last_move >> 4) & 0xf;
-	move_history.pop_back();
+	assert(hisPly > 0);
+	const S_UNDO& undo = move_history[--hisPly];
+	int move = undo.move;
+	int from = FROM_SQ(move);
+	int to = TO_SQ(move);
+	int captured = CAPTURED_PIECE(move);
+	int flag = MOVE_FLAG(move);
+
+	// The previous ply's accumulator is still on the stack, so the piece
+	// updates below leave the accumulators alone.
+	bool nnue = accumulator != NULL;
+	accumulator = NULL;
+
 	switch_turn();
-	// --ply;
+
+	if (PROMOTED_PIECE(move) != WhitePawn)
+	{
+		remove_piece(to);
+		add_piece(MOVED_PIECE(move), to);
+	}
+
+	move_piece(to, from);
+
+	if (flag == FLAG_CASTLE)
+	{
+		if (to > from) move_piece(from + 1, from + 3);
+		else move_piece(from - 1, from - 4);
+	}
+
+	if (flag == FLAG_EN_PASSANT) add_piece(captured, to + (turn == White ? 8 : -8));
+	else if (captured != Empty) add_piece(captured, to);
+
+	// Irreversible state comes straight from the undo record, which also
+	// brings back the key without replaying the XORs.
+	castling = undo.castling;
+	en_pas = undo.en_pas;
+	fifty_move = undo.fifty_move;
+	pos_key = undo.pos_key;
+
+	if (nnue) accumulator = &accumulator_stack[hisPly];
+
+	assert(pos_key == generate_position_key());
+	assert(pawn_key == generate_pawn_key());
+	assert(psq_score == generate_psq_score());
+	assert(accumulator_matches());
 }
 
 void Board::make_null_move() {
+	move_history[hisPly++] = { 0, castling, en_pas, fifty_move, pos_key };
+	if (accumulator)
+	{
+		accumulator_stack[hisPly] = *accumulator;
+		accumulator = &accumulator_stack[hisPly];
+	}
+	set_en_pas(NO_SQUARE);
 	switch_turn();
-	ply++;
 }
 
 void Board::undo_null_move() {
+	const S_UNDO& undo = move_history[--hisPly];
+
 	switch_turn();
-	ply--;
+	en_pas = undo.en_pas;
+	pos_key = undo.pos_key;
+	if (accumulator) accumulator = &accumulator_stack[hisPly];
 }
 
-int Board::perft(int depth) {
-	std::vector<S_MOVE> moves = generate_moves();
-	int nodes = 0;
+void Board::save_state(S_BOARD_STATE& state) {
+	memcpy(state.squares, squares, sizeof(squares));
+	memcpy(state.pieces, pieces, sizeof(pieces));
+	memcpy(state.occupancy, occupancy, sizeof(occupancy));
+	state.occupied = occupied;
+	memcpy(state.piece_list, piece_list, sizeof(piece_list));
+	memcpy(state.piece_count, piece_count, sizeof(piece_count));
+	memcpy(state.list_index, list_index, sizeof(list_index));
+	state.turn = turn;
+	state.castling = castling;
+	state.en_pas = en_pas;
+	state.fifty_move = fifty_move;
+	state.pos_key = pos_key;
+	state.pawn_key = pawn_key;
+	state.psq_score = psq_score;
+	state.phase = phase;
+}
 
-	if (depth == 0) return nodes + 1;
+void Board::restore_state(const S_BOARD_STATE& state) {
+	memcpy(squares, state.squares, sizeof(squares));
+	memcpy(pieces, state.pieces, sizeof(pieces));
+	memcpy(occupancy, state.occupancy, sizeof(occupancy));
+	occupied = state.occupied;
+	memcpy(piece_list, state.piece_list, sizeof(piece_list));
+	memcpy(piece_count, state.piece_count, sizeof(piece_count));
+	memcpy(list_index, state.list_index, sizeof(list_index));
+	turn = state.turn;
+	castling = state.castling;
+	en_pas = state.en_pas;
+	fifty_move = state.fifty_move;
+	pos_key = state.pos_key;
+	pawn_key = state.pawn_key;
+	psq_score = state.psq_score;
+	phase = state.phase;
+	refresh_accumulator();
+}
 
-	for (S_MOVE move : moves)
+void Board::refresh_accumulator() {
+	if (!nnue_loaded())
 	{
-		make_move(move.move);
-		nodes += perft(depth - 1);
-		undo_last_move();
+		accumulator = NULL;
+		return;
 	}
 
-	return nodes;
+	if (accumulator_stack.empty()) accumulator_stack.resize(MAX_GAME_MOVES + 1);
+	accumulator = &accumulator_stack[hisPly];
+	nnue_refresh(*accumulator, squares);
+}
+
+// Whether the incremental accumulator matches one computed from scratch
+bool Board::accumulator_matches() {
+	if (!accumulator) return true;
+
+	S_ACCUMULATOR fresh;
+	nnue_refresh(fresh, squares);
+	return memcmp(&fresh, accumulator, sizeof(fresh)) == 0;
 }
 
-u64 rand_key()
+// xorshift64* with a fixed seed, so every process gets the same keys
+static u64 key_state = 0x9e3779b97f4a7c15ULL;
+
+static u64 rand_key()
 {
-	return (u64)rand() + ((u64)rand() << 15) + ((u64)rand() << 30) + ((u64)rand() << 45) + (((u64)rand() & 0xf) << 60);
+	key_state ^= key_state >> 12;
+	key_state ^= key_state << 25;
+	key_state ^= key_state >> 27;
+	return key_state * 2685821657736338717ULL;
 }
 
 void Board::init_hash_keys()
 {
-	for (int i = 0; i < 13; ++i)
+	for (int i = 0; i < 12; ++i)
 	{
-		for (int j = 0; j < 128; ++j)
+		for (int j = 0; j < 64; ++j)
 		{
 			piece_keys[i][j] = rand_key();
 		}
 	}
 	turn_key = rand_key();
+
+	// castle_keys[0] stays zero so a side with no rights adds nothing.
+	castle_keys[0] = 0ULL;
+	for (int i = 1; i < 16; ++i) castle_keys[i] = rand_key();
+	for (int i = 0; i < 64; ++i) en_pas_keys[i] = rand_key();
 }
 
-u64 Board::position_key()
+// Compute the position key from scratch. The incremental key kept in
+// pos_key must always match this.
+u64 Board::generate_position_key()
 {
 	u64 final_key = 0;
-	int piece = Empty;
-	for (int i = 0; i < squares.size(); ++i)
+	u64 bb = occupied;
+	while (bb)
 	{
-		piece = squares[i];
-		if ((i & 0x88) == 0 && piece != Empty)
-		{
-			final_key ^= piece_keys[piece][i];
-		}
+		int sq = pop_lsb(bb);
+		final_key ^= piece_keys[squares[sq]][sq];
 	}
-	if (turn == White) final_key ^= turn_key;
+	if (turn == Black) final_key ^= turn_key;
+	final_key ^= castle_keys[castling];
+	if (en_pas != NO_SQUARE) final_key ^= en_pas_keys[en_pas];
 	return final_key;
 }
 
-bool Board::in_check()
-{
-	int king_position = std::find(squares.begin(), squares.end(), turn == White ? WhiteKing : BlackKing) - squares.begin();
-	return is_square_attacked(king_position, turn ^ 1);
-}
-
-bool Board::is_opponent_in_check()
-{
-	int king_position = std::find(squares.begin(), squares.end(), turn == White ? BlackKing : WhiteKing) - squares.begin();
-	return is_square_attacked(king_position, turn);
-}
-
-bool Board::move_exists(int move)
+u64 Board::generate_pawn_key()
 {
-	for (S_MOVE c_move : generate_moves())
+	u64 key = 0;
+	for (int piece = WhitePawn; piece <= BlackPawn; piece += BlackPawn)
 	{
-		if (c_move.move == move) return true;
+		u64 bb = pieces[piece];
+		while (bb)
+		{
+			key ^= piece_keys[piece][pop_lsb(bb)];
+		}
 	}
-	return false;
+	return key;
 }
 
-void Board::init_pv_table()
+bool Board::in_check()
 {
-	pv_table->num_entries = PV_SIZE / sizeof(PV_ENTRY);
-	pv_table->num_entries -= 5;
-	if (pv_table->p_table != NULL) free(pv_table->p_table);
-	pv_table->p_table = (PV_ENTRY*)malloc(pv_table->num_entries * sizeof(PV_ENTRY));
-	clear_pv_table();
-
-	std::cout << "pv table init complete with " << pv_table->num_entries << " entries\n";
+	return is_square_attacked(king_square(turn), turn ^ 1);
 }
 
-void Board::clear_pv_table()
+bool Board::is_opponent_in_check()
 {
-	PV_ENTRY* pv_entry;
-	for (pv_entry = pv_table->p_table; pv_entry < pv_table->p_table + pv_table->num_entries; ++pv_entry)
-	{
-		pv_entry->pos_key = 0ULL;
-		pv_entry->move = 0;
-	}
+	return is_square_attacked(king_square(turn ^ 1), turn);
 }
 
-void Board::store_pv_move(int move)
+// Find the legal move matching a from/to pair and, for promotions, the
+// piece promoted to (WhitePawn otherwise). Returns 0 if there is none.
+int Board::find_move(int from, int to, int promoted)
 {
-	int index = position_key() % pv_table->num_entries;
-
-	assert(index >= 0 && index <= pv_table->num_entries - 1);
-
-	pv_table->p_table[index].move = move;
-	pv_table->p_table[index].pos_key = position_key();
-}
-
-int Board::probe_pv_table() {
-	int index = position_key() % pv_table->num_entries;
+	S_MOVELIST list;
+	generate_to(list, BIT(to));
 
-	if (pv_table->p_table[index].pos_key == position_key())
+	for (int i = 0; i < list.count; ++i)
 	{
-		return pv_table->p_table[index].move;
+		int move = list.moves[i].move;
+		if (FROM_SQ(move) == from && PROMOTED_PIECE(move) == promoted) return move;
 	}
-
 	return 0;
 }
 
-int Board::get_pv_line(int depth)
+// Full legal move for a packed 16-bit move, or 0 if it is not legal here,
+// which also catches moves from another position sharing a hash slot.
+int Board::expand_move(int packed)
 {
-	assert(depth < MAX_DEPTH);
+	if (packed == 0) return 0;
+
+	int code = packed >> 12;
+	int promoted = code == 0 ? WhitePawn : code + (turn == White ? WhitePawn : BlackPawn);
+	return find_move(packed & 0x3f, (packed >> 6) & 0x3f, promoted);
+}
 
-	int move = probe_pv_table();
-	int count = 0;
+bool Board::move_exists(int move)
+{
+	// Only moves landing on the same square can match
+	S_MOVELIST list;
+	generate_to(list, BIT(TO_SQ(move)));
 
-	while (move != 0 && count < depth)
+	for (int i = 0; i < list.count; ++i)
 	{
-		if (move_exists(move))
-		{
-			make_move(move);
-			pv_array[count++] = move;
-		}
-		else {
-			break;
-		}
-		move = probe_pv_table();
+		if (list.moves[i].move == move) return true;
 	}
-
-	for (int i = 0; i < count; ++i) undo_last_move();
-	return count;
+	return false;
 }
 
 void Board::init_mvv_lva()
@@ -397,3 +548,13 @@ void Board::init_mvv_lva()
 	}
 }
 
+void Board::init_tables()
+{
+	static std::once_flag once;
+	std::call_once(once, []() {
+		init_bitboards();
+		init_hash_keys();
+		init_mvv_lva();
+		init_eval();
+	});
+}
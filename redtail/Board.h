@@ -1,6 +1,7 @@
 #include<string>
 #include <vector>
-#include <unordered_map>
+#include "Bitboard.h"
+#include "Nnue.h"
 #pragma once
 
 static std::string PIECE_CHAR_MAP = "PNBRQKpnbrqk. *";
@@ -22,6 +23,11 @@ enum {
     OffBoard
 };
 
+// Game phase weight of each piece. MAX_PHASE, the starting material, is
+// a pure midgame and zero a pure endgame.
+const int PHASE_WEIGHT[12] = { 0, 1, 1, 2, 4, 0, 0, 1, 1, 2, 4, 0 };
+const int MAX_PHASE = 24;
+
 const int VICTIM_SCORE[14] = { 100, 200, 300, 400, 500, 600, 100, 200, 300, 400, 500, 600, 0, 0 };
 
 enum {
@@ -30,91 +36,226 @@ enum {
     None
 };
 
+// Castling rights, stored as a bitmask
+enum {
+    WhiteKingSide = 1,
+    WhiteQueenSide = 2,
+    BlackKingSide = 4,
+    BlackQueenSide = 8
+};
+
+// en_pas value when no en passant capture is available
+const int NO_SQUARE = 64;
+
+// Moves are packed into an int as promoted << 26 | from << 20 | to << 12 |
+// piece << 8 | captured << 4 | flag, with squares numbered 0..63 from a8.
+// The promoted field is zero (WhitePawn) for anything but a promotion.
+#define createMove(f, t, pi, cp, fl) (((f) << 20) | ((t) << 12) | ((pi) << 8) | ((cp) << 4) | (fl))
+#define createPromotion(f, t, pi, cp, fl, pr) (createMove(f, t, pi, cp, fl) | ((pr) << 26))
+#define FROM_SQ(m) (((m) >> 20) & 0x3f)
+#define TO_SQ(m) (((m) >> 12) & 0x3f)
+#define MOVED_PIECE(m) (((m) >> 8) & 0xf)
+#define CAPTURED_PIECE(m) (((m) >> 4) & 0xf)
+#define MOVE_FLAG(m) ((m) & 0xf)
+#define PROMOTED_PIECE(m) (((m) >> 26) & 0xf)
+
+// 16-bit form of a move, as kept in the transposition table: from | to << 6
+// | promoted piece type << 12. Board::expand_move turns it back into a
+// full move.
+#define PACK_MOVE(m) (FROM_SQ(m) | (TO_SQ(m) << 6) | ((PROMOTED_PIECE(m) % 6) << 12))
+
+// Values of the move flag field
+enum {
+    FLAG_QUIET,
+    FLAG_CAPTURE,
+    FLAG_DOUBLE_PUSH,
+    FLAG_EN_PASSANT,
+    FLAG_CASTLE
+};
+
 typedef struct {
     int move;
     int score;
 } S_MOVE;
 
-enum {
-    TT_EXACT,
-    TT_ALPHA,
-    TT_BETA
-};
+// Upper bound on the number of moves in any position
+const int MAX_MOVES = 256;
 
+// Fixed-capacity move list, meant to live on the stack and be filled in
+// place by the generators.
 typedef struct {
-    int flag;
-    int score;
-    int depth;
-    int move;
-} TT_ENTRY;
+    S_MOVE moves[MAX_MOVES];
+    int count;
+} S_MOVELIST;
 
 typedef struct {
     int starttime;
     int stoptime;
     int depth;
     int depthset;
-    int timeset;
+    int timeset;    // Hard limit in ms, the search stops as soon as it passes
+    int softtime;   // No new iteration is started once this is used up
+    u64 nodeset;    // Node limit, 0 for none
     int quit;
     int stopped;
     int movestogo;
     int infinite;
-    long nodes;
+    u64 nodes;
     float fh;
     float fhf;
+    u64 eval_hits;  // Static evaluations answered by the eval cache
+    u64 eval_misses;
+    int thread_id;  // 0 for the main search thread, helpers count from 1
+    int depth_done; // Last iteration finished before the search stopped
+    int best_move;  // Best move of that iteration
 } S_SEARCHINFO;
 
-typedef unsigned long long u64;
-
+// State needed to take back a move that cannot be recovered from the
+// move itself.
 typedef struct
 {
-    u64 pos_key;
     int move;
-} PV_ENTRY;
+    int castling;
+    int en_pas;
+    int fifty_move;
+    u64 pos_key;
+} S_UNDO;
 
+// Longest game the undo stack can hold, in plies
+const int MAX_GAME_MOVES = 2048;
+
+// Most pieces of one kind that can be on the board, promotions included
+const int MAX_PIECES = 10;
+
+// Cached pawn structure evaluation: the packed score from White's side
+// and the passed pawns of each side.
 typedef struct
 {
-    PV_ENTRY* p_table;
-    int num_entries;
-} PV_TABLE;
+    u64 key;
+    int score;
+    u64 passed[2];
+} S_PAWN_ENTRY;
+
+// Entries in each board's pawn hash table, a power of two
+const int PAWN_TABLE_ENTRIES = 4096;
 
+// Full copy of the position, for copy-make and for handing a position to
+// another Board.
 typedef struct
 {
-    int cmove;
-    S_MOVE argmove[100];
-} PV_LINE;
+    int squares[64];
+    u64 pieces[12];
+    u64 occupancy[2];
+    u64 occupied;
+    int piece_list[12][MAX_PIECES];
+    int piece_count[12];
+    int list_index[64];
+    int turn;
+    int castling;
+    int en_pas;
+    int fifty_move;
+    u64 pos_key;
+    u64 pawn_key;
+    int psq_score;
+    int phase;
+} S_BOARD_STATE;
 
 class Board
 {
 private:
-	std::string castling;
-	std::string en_pas;
-
-    int white_king_position;
-    int black_king_position;
+    int castling;
+    int en_pas;
+    int fifty_move;
 
     // Useful utils
-    bool is_square_attacked(int pos, int attacker);
     int get_color(int piece);
+    void add_moves(S_MOVELIST& list, int from, int piece, u64 targets);
+
+    // Legal move generation helpers
+    u64 attackers_to(int pos, u64 occ);
+    u64 pinned_pieces(int king_sq);
+    void generate_piece_moves(S_MOVELIST& list, u64 targets, u64 pinned, int king_sq);
+    void generate_king_moves(S_MOVELIST& list, u64 targets, int king_sq);
+    void generate_evasions(S_MOVELIST& list, u64 targets, int king_sq, u64 checkers, u64 pinned);
+    void generate_to(S_MOVELIST& list, u64 targets);
 
-    std::vector<int> move_history;
+    void add_piece(int piece, int sq);
+    void remove_piece(int sq);
+    void move_piece(int from, int to);
 
-    // Hash keys for position key generation
-    u64 piece_keys[13][128];
-    u64 turn_key;
+    void generate_castling(S_MOVELIST& list, u64 targets);
+    void generate_en_passant(S_MOVELIST& list, u64 targets, int king_sq);
+    void add_pawn_moves(S_MOVELIST& list, int from, int to, int flag);
 
-    void init_hash_keys();
+    // Undo records, one per move made, indexed by hisPly
+    S_UNDO move_history[MAX_GAME_MOVES];
+
+    // Hash keys for position key generation, shared by every board
+    static u64 piece_keys[12][64];
+    static u64 turn_key;
+    static u64 castle_keys[16];
+    static u64 en_pas_keys[64];
+
+    static void init_hash_keys();
+
+    // Zobrist key of the current position, updated incrementally
+    u64 pos_key;
+    u64 generate_position_key();
+
+    // Zobrist key of the pawns alone, updated alongside pos_key, and the
+    // pawn structure cache it indexes. Every search thread has a board of
+    // its own, so the cache is never shared.
+    u64 pawn_key;
+    u64 generate_pawn_key();
+    std::vector<S_PAWN_ENTRY> pawn_table;
+    const S_PAWN_ENTRY& probe_pawns();
+    int evaluate_pawns(int color, u64& passed);
+    int king_shield(int color);
+
+    // Material and piece-square score from White's side, midgame and
+    // endgame packed together, kept up to date by add_piece, remove_piece
+    // and move_piece. psq_table holds what each piece contributes on each
+    // square. phase sums PHASE_WEIGHT over the pieces on the board.
+    int psq_score;
+    int phase;
+    int generate_psq_score();
+    static int psq_table[12][64];
+    static void init_eval();
+
+    // NNUE accumulators, one per ply like move_history, allocated once a
+    // network is first used. accumulator points at the entry for the
+    // current ply, which add_piece, remove_piece and move_piece keep up to
+    // date, and is NULL while no network is in use.
+    std::vector<S_ACCUMULATOR> accumulator_stack;
+    S_ACCUMULATOR* accumulator;
+    bool accumulator_matches();
+
+    void set_castling(int rights);
+    void set_en_pas(int sq);
 
-    int ply;
     int hisPly;
 
 public:
 	Board();
-	~Board();
 
-    // Most important property. This contains the actual board state
-    // represented as a array os size 128.
-    // en.wikipedia.org/wiki/0x88
-    std::vector<int> squares;
+    // Most important property. This contains the actual board state as
+    // the piece on each of the 64 squares, a8 first.
+    int squares[64];
+
+    // Bitboards mirroring squares: one set per piece, one per colour and
+    // the union of both colours.
+    u64 pieces[12];
+    u64 occupancy[2];
+    u64 occupied;
+
+    // Piece lists: the squares holding each piece, with list_index mapping
+    // an occupied square back to its slot so a piece is moved or removed
+    // in constant time.
+    int piece_list[12][MAX_PIECES];
+    int piece_count[12];
+    int list_index[64];
+
+    int king_square(int color) { return piece_list[color == White ? WhiteKing : BlackKing][0]; }
 
 	void set_fen(std::string fen);
 	void draw();
@@ -123,61 +264,55 @@ public:
     void make_null_move();
     void undo_null_move();
     void undo_last_move();
-    int perft(int depth);
+    u64 perft(int depth);
 
-    int nodes;
+    // Copy-make: save_state copies the whole position out, restore_state
+    // puts it back, as an alternative to undo_last_move.
+    void save_state(S_BOARD_STATE& state);
+    void restore_state(const S_BOARD_STATE& state);
+    u64 perft_copy(int depth);
 
     // Move Generation
-    std::vector<S_MOVE> generate_pseudo_moves();
-    std::vector<S_MOVE> generate_moves();
-    std::vector<S_MOVE> ordered_moves();
+    void generate_moves(S_MOVELIST& list);
+    void generate_captures(S_MOVELIST& list);
+    void generate_quiets(S_MOVELIST& list);
+    void ordered_moves(S_MOVELIST& list);
 
     std::string get_ref(int position);
     std::string get_move_ref(int move);
 
-	std::unordered_map<u64, int> trans_table;
-    std::unordered_map<u64, TT_ENTRY> transposition_table;
-
     // Stores the color whose turn it is to play
     int turn;
     int switch_turn();
 
     bool in_check();
+    bool is_square_attacked(int pos, int attacker);
     bool is_opponent_in_check();
 
-    // Evaluation
-    // int search(S_SEARCHINFO *info);
-    int search();
+    // Evaluation, from the network when one is loaded
     int get_score();
-    // int quiesce(int alpha, int beta, S_SEARCHINFO *info);
-    int quiesce(int alpha, int beta);
-    // int alpha_beta(int alpha, int beta, int depth, S_SEARCHINFO *info, bool do_null);
-    int alpha_beta(int alpha, int beta, int depth, bool do_null);
-    int search_position(S_SEARCHINFO *info);
-    void clear_for_search();
 
-    S_SEARCHINFO search_info;
+    // Pick up a network loaded or unloaded since the position was set up
+    void refresh_accumulator();
+
+    u64 position_key() { return pos_key; }
 
-    u64 position_key();
+    // Move that led to this position, 0 at the start or after a null move
+    int last_move() { return hisPly > 0 ? move_history[hisPly - 1].move : 0; }
 
     bool move_exists(int move);
+    int find_move(int from, int to, int promoted);
+    int expand_move(int packed);
     bool is_capture(int move);
 
-    int mvv_lva_scores[13][13];
-    void init_mvv_lva();
+    static int mvv_lva_scores[13][13];
+    static void init_mvv_lva();
 
-    static const int MAX_DEPTH = 100;
-
-    // Principal Variation Table
-	const int PV_SIZE = 0x100000 * 5;
+    // Set up every process-wide table: attacks, hash keys and move
+    // ordering scores. Runs once however many boards are created, from
+    // whichever thread gets there first.
+    static void init_tables();
 
-    PV_TABLE pv_table[1];
-    int pv_array[100];
-
-    void init_pv_table();
-    void clear_pv_table();
-    void store_pv_move(int move);
-    int probe_pv_table();
-    int get_pv_line(int depth);
+    static const int MAX_DEPTH = 100;
 };
 
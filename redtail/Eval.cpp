@@ -1,247 +1,154 @@
 #include "Board.h"
 #include "Eval.h"
-#include <iostream>
-#include <chrono>
-#include <unordered_map>
 #include <algorithm>
 
-#define INFINITY 30000
-#define MATE 29900
-
-int get64pos(int pos)
-{
-	return (pos % 8) + (floor(pos / 16) * 8);
-}
-
-int get_time_ms()
-{
-	return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
-}
-
 bool Board::is_capture(int move) {
 	int piece_at_dest = (move >> 4) & 0xf;
 	return piece_at_dest != Empty && piece_at_dest != OffBoard;
 }
 
-std::vector<S_MOVE> Board::ordered_moves() {
-	std::vector<S_MOVE> unordered_moves = generate_moves();
-	std::sort(unordered_moves.begin(), unordered_moves.end(), [](const S_MOVE& x, const S_MOVE& y) {
+void Board::ordered_moves(S_MOVELIST& list) {
+	generate_moves(list);
+	std::sort(list.moves, list.moves + list.count, [](const S_MOVE& x, const S_MOVE& y) {
 		return x.score > y.score;
 	});
-	return unordered_moves;
 }
 
-int Board::quiesce(int alpha, int beta) {
-
-	if (search_info.nodes & 2047) {
-		if ((get_time_ms() - search_info.starttime) > search_info.timeset) search_info.stopped = true;
-	}
-
-	search_info.nodes++;
-
-	int stand_pat = get_score();
-	if (stand_pat >= beta) return beta;
-	if (alpha < stand_pat) alpha = stand_pat;
-
-	std::vector<S_MOVE> moves = ordered_moves();
+int Board::psq_table[12][64];
 
-	for (S_MOVE move : moves) {
-		if (is_capture(move.move)) {
-			make_move(move.move);
-			int score = -quiesce(-beta, -alpha);
-			undo_last_move();
+// Pawn structure masks, indexed by colour and square: the squares in front
+// on the same and the adjacent files, the adjacent files level with the
+// square or behind it, and the two ranks in front of a king on its own and
+// the adjacent files.
+static u64 PassedMask[2][64];
+static u64 SupportMask[2][64];
+static u64 ShieldMask[2][64];
+static u64 AdjacentFiles[8];
 
-			if (score >= beta) return beta;
-			if (score > alpha) alpha = score;
-		}
-	}
-
-	return alpha;
+static u64 row_bb(int row)
+{
+	return row < 0 || row > 7 ? 0ULL : 0xffULL << (row * 8);
 }
 
-#define R 2
-
-int Board::alpha_beta(int alpha, int beta, int depth, bool do_null) {
-	if (search_info.nodes & 2047) {
-		if ((get_time_ms() - search_info.starttime) > search_info.timeset) search_info.stopped = true;
-	}
-
-	if (search_info.stopped) return 0;
-
-	int best_score = -INFINITY;
-	int best_move = 0;
-	int old_alpha = alpha;
-
-	u64 pos_key = position_key();
-
-	search_info.nodes++;
+// Packed midgame and endgame value of every piece on every square,
+// positive for White and negative for Black, which reads the tables
+// mirrored.
+void Board::init_eval()
+{
+	for (int piece = WhitePawn; piece <= WhiteKing; ++piece)
+	{
+		for (int sq = 0; sq < 64; ++sq)
+		{
+			int white = S(MgValue[piece] + MgTables[piece][sq], EgValue[piece] + EgTables[piece][sq]);
+			int black = S(MgValue[piece] + MgTables[piece][Mirror64[sq]], EgValue[piece] + EgTables[piece][Mirror64[sq]]);
 
-	if (transposition_table.find(pos_key) != transposition_table.end()) {
-		TT_ENTRY stored = transposition_table[pos_key];
-		if (stored.depth >= depth) {
-			if (stored.flag == TT_EXACT) return stored.score;
-			if (stored.flag == TT_ALPHA && stored.score <= alpha) return alpha;
-			if (stored.flag == TT_BETA && stored.score >= beta) return beta;
+			psq_table[piece][sq] = white;
+			psq_table[piece + BlackPawn][sq] = -black;
 		}
 	}
 
-	if (depth == 0) {
-		int val = quiesce(alpha, beta);
-		transposition_table.insert({ pos_key, {TT_EXACT, val, depth, 0} });
-		return val;
+	for (int file = 0; file < 8; ++file)
+	{
+		AdjacentFiles[file] = (file > 0 ? FileABB << (file - 1) : 0ULL) | (file < 7 ? FileABB << (file + 1) : 0ULL);
 	}
 
-	if (do_null && ply > 0 && !in_check() && depth >= 4) {
-		make_null_move();
-		int null_move_val = -alpha_beta(-beta, -beta + 1, depth - 4, false);
-		undo_null_move();
-
-		if (search_info.stopped) return 0;
-		if (null_move_val >= beta) {
-			transposition_table.insert({ pos_key, {TT_BETA, beta, depth, 0} });
-			return beta;
-		}
-			
+	for (int sq = 0; sq < 64; ++sq)
+	{
+		int row = ROW_OF(sq);
+		u64 files = AdjacentFiles[FILE_OF(sq)] | (FileABB << FILE_OF(sq));
+		u64 above = 0ULL, below = 0ULL;
+		for (int r = 0; r < row; ++r) above |= row_bb(r);
+		for (int r = row + 1; r < 8; ++r) below |= row_bb(r);
+
+		// White pawns advance towards row 0, Black pawns towards row 7
+		PassedMask[White][sq] = files & above;
+		PassedMask[Black][sq] = files & below;
+		SupportMask[White][sq] = AdjacentFiles[FILE_OF(sq)] & (below | row_bb(row));
+		SupportMask[Black][sq] = AdjacentFiles[FILE_OF(sq)] & (above | row_bb(row));
+		ShieldMask[White][sq] = files & (row_bb(row - 1) | row_bb(row - 2));
+		ShieldMask[Black][sq] = files & (row_bb(row + 1) | row_bb(row + 2));
 	}
+}
 
-	std::vector<S_MOVE> moves = ordered_moves();
-
-	for (S_MOVE move : moves) {
-		make_move(move.move);
-		int score = -alpha_beta(-beta, -alpha, depth - 1, !do_null);
-		undo_last_move();
-
-		if (search_info.stopped) return 0;
-
-		if (score > alpha) {
-			alpha = score;
-
-			store_pv_move(move.move);
+// Pawn structure score of one side, packed and from that side's point of
+// view, also returning its passed pawns. Only depends on the pawns, which
+// is what lets probe_pawns cache it.
+int Board::evaluate_pawns(int color, u64& passed)
+{
+	u64 ours = pieces[color == White ? WhitePawn : BlackPawn];
+	u64 theirs = pieces[color == White ? BlackPawn : WhitePawn];
+	int score = 0;
+	passed = 0ULL;
 
-			if (score >= beta) {
-				transposition_table.insert({ pos_key, {TT_BETA, beta, depth, move.move} });
-				return beta;
-			}
+	u64 bb = ours;
+	while (bb)
+	{
+		int sq = pop_lsb(bb);
+		int file = FILE_OF(sq);
+		int stop = sq + (color == White ? -8 : 8);
+		u64 front = PassedMask[color][sq] & (FileABB << file);
+
+		// Only the front pawn of a doubled pair can be passed
+		if (ours & front) score += DoubledPawn;
+		else if (!(theirs & PassedMask[color][sq]))
+		{
+			passed |= BIT(sq);
+			score += PassedBonus[color == White ? 7 - ROW_OF(sq) : ROW_OF(sq)];
 		}
-	}
 
-	transposition_table.insert({ pos_key, {TT_ALPHA, alpha, depth, best_move} });
-	return alpha;
+		// Backward: no neighbour can come up to defend it and an enemy pawn
+		// guards the square it would advance to.
+		if (!(ours & AdjacentFiles[file])) score += IsolatedPawn;
+		else if (!(ours & SupportMask[color][sq]) && (PawnAttacks[color][stop] & theirs)) score += BackwardPawn;
+	}
+	return score;
 }
 
-void Board::clear_for_search() {
-	search_info.stopped = false;
-	search_info.nodes = 0;
-	search_info.depth = 1;
-	search_info.timeset = 5000;
-	search_info.starttime = get_time_ms();
+// Look up the pawn structure, evaluating it on a miss
+const S_PAWN_ENTRY& Board::probe_pawns()
+{
+	S_PAWN_ENTRY& entry = pawn_table[pawn_key & (PAWN_TABLE_ENTRIES - 1)];
+	if (entry.key == pawn_key) return entry;
 
-	clear_pv_table();
+	entry.key = pawn_key;
+	entry.score = evaluate_pawns(White, entry.passed[White]) - evaluate_pawns(Black, entry.passed[Black]);
+	return entry;
 }
 
-int Board::search() {
-	int best_score = -INFINITY;
-	int score = -INFINITY;
-
-	int alpha = -INFINITY;
-	int beta = INFINITY;
-
-	clear_for_search();
-
-	int last_pv_array[100];
-
-	int best_move;
-
-	while (true) {
-		int curr_time = get_time_ms();
-		if (search_info.stopped || search_info.depth > MAX_DEPTH) break;
-
-		score = alpha_beta(alpha, beta, search_info.depth, true);
-
-		if (score > best_score) best_score = score;
-		else {
-			if (search_info.stopped) break;
-		}
-
-		// if (best_score <= alpha || best_score >= beta) {
-		// 	alpha = -INFINITY;
-		// 	beta = INFINITY;
-		// 	continue;
-		// }
-
-		// alpha = best_score - 50;
-		// beta = best_score + 50;
-
-		int pv_moves = get_pv_line(search_info.depth);
-		best_move = pv_array[0];
-
-		std::cout << "info depth " << search_info.depth << " time " << curr_time - search_info.starttime << " nodes " << search_info.nodes << " score cp " << score << " currmove " << get_move_ref(pv_array[0]);
-
-		printf(" pv");
-		for (int pv_num = 0; pv_num < pv_moves; ++pv_num)
-		{
-			printf(" %s", get_move_ref(pv_array[pv_num]).c_str());
-		}
-		printf("\n");
+// The shield depends on where the king is, so it is left out of the cache
+int Board::king_shield(int color)
+{
+	u64 ours = pieces[color == White ? WhitePawn : BlackPawn];
+	return pop_count(ShieldMask[color][king_square(color)] & ours) * ShieldPawn;
+}
 
-		search_info.depth++;
+// Recompute psq_score from scratch. The incremental score must always
+// match this.
+int Board::generate_psq_score()
+{
+	int score = 0;
+	for (int piece = WhitePawn; piece <= BlackKing; ++piece)
+	{
+		for (int n = 0; n < piece_count[piece]; ++n) score += psq_table[piece][piece_list[piece][n]];
 	}
-
-	return best_move;
+	return score;
 }
 
+// Static score from the side to move's point of view: the midgame and
+// endgame halves blended by how much material is left, unless a network
+// is loaded.
 int Board::get_score()
 {
-	int score = 0;
-	for (int i = 0; i < squares.size(); ++i)
-	{
-		int piece = squares[i];
-		if (piece == Empty || (i & 0x88) != 0)
-			continue;
+	if (accumulator) return nnue_evaluate(*accumulator, turn);
 
-		switch (piece)
-		{
-		case WhiteKing:
-			score += 50000;
-			break;
-		case WhitePawn:
-			score += 100  +PawnTable[get64pos(i)];
-			break;
-		case WhiteRook:
-			score += 500  +RookTable[get64pos(i)];
-			break;
-		case WhiteBishop:
-			score += 330  +BishopTable[get64pos(i)];
-			break;
-		case WhiteQueen:
-			score += 900  +BishopTable[get64pos(i)] + RookTable[get64pos(i)];
-			break;
-		case WhiteKnight:
-			score += 320  +KnightTable[get64pos(i)];
-			break;
-
-		case BlackKing:
-			score -= 50000;
-			break;
-		case BlackPawn:
-			score -= 100  +PawnTable[Mirror64[get64pos(i)]];
-			break;
-		case BlackRook:
-			score -= 500  +RookTable[Mirror64[get64pos(i)]];
-			break;
-		case BlackBishop:
-			score -= 330  +BishopTable[Mirror64[get64pos(i)]];
-			break;
-		case BlackQueen:
-			score -= 900  +BishopTable[Mirror64[get64pos(i)]] + RookTable[Mirror64[get64pos(i)]];
-			break;
-		case BlackKnight:
-			score -= 320  +KnightTable[Mirror64[get64pos(i)]];
-			break;
-		}
-	}
+	const S_PAWN_ENTRY& pawns = probe_pawns();
+	int packed = psq_score + pawns.score + king_shield(White) - king_shield(Black);
 
-	if (turn == White) return score;
-	else return -score;
-}
+	// Passed pawns free to advance, read off the cached masks
+	packed += (pop_count((pawns.passed[White] >> 8) & ~occupied) - pop_count((pawns.passed[Black] << 8) & ~occupied)) * PassedFree;
 
+	int p = std::min(phase, MAX_PHASE);
+	int score = (mg_value(packed) * p + eg_value(packed) * (MAX_PHASE - p)) / MAX_PHASE;
+
+	return turn == White ? score : -score;
+}
@@ -0,0 +1,78 @@
+// MicroBench.cpp : times the board primitives the search leans on, one
+// position at a time, and reports the average cost of a call.
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <string>
+#include "Board.h"
+
+static const char* POSITIONS[][2] = {
+	{ "startpos", "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1" },
+	{ "kiwipete", "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1" },
+	{ "middlegame", "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10" },
+	{ "endgame", "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1" },
+};
+
+// Results are folded into the sink so the timed calls can't be optimised
+// away.
+static volatile u64 sink;
+
+// Run op for iterations calls and print the average time per call.
+template <typename F>
+static void time_op(const std::string& name, long iterations, F op)
+{
+	auto start = std::chrono::steady_clock::now();
+	for (long i = 0; i < iterations; ++i) op();
+	auto end = std::chrono::steady_clock::now();
+
+	double ns = std::chrono::duration<double, std::nano>(end - start).count() / iterations;
+	std::cout << "  " << std::left << std::setw(20) << name << std::right << std::fixed << std::setprecision(1) << std::setw(10) << ns << " ns/op" << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+	long iterations = argc > 1 ? std::stol(argv[1]) : 1000000;
+	Board board = Board();
+
+	for (auto& position : POSITIONS)
+	{
+		board.set_fen(position[1]);
+		std::cout << position[0] << ": " << position[1] << std::endl;
+
+		S_MOVELIST list;
+		board.generate_moves(list);
+		int moves = list.count;
+
+		time_op("generate_moves", iterations, [&]() {
+			board.generate_moves(list);
+			sink += list.count;
+		});
+
+		time_op("get_score", iterations, [&]() {
+			sink += board.get_score();
+		});
+
+		time_op("position_key", iterations, [&]() {
+			sink += board.position_key();
+		});
+
+		// Every square, for both attackers, per call
+		time_op("is_square_attacked", iterations / 64, [&]() {
+			for (int sq = 0; sq < 64; ++sq)
+				sink += board.is_square_attacked(sq, White) + board.is_square_attacked(sq, Black);
+		});
+
+		// Every legal move played and taken back, per call
+		time_op("make/unmake", iterations / moves, [&]() {
+			for (int i = 0; i < moves; ++i)
+			{
+				board.make_move(list.moves[i].move);
+				sink += board.position_key();
+				board.undo_last_move();
+			}
+		});
+	}
+
+	return 0;
+}
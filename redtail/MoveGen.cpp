@@ -1,209 +1,274 @@
 #include <vector>
 #include <iostream>
 #include "Board.h"
-#include "MoveGen.h"
-#pragma	once
 
-#define createMove(f, t, pi, pt, tp) ((f << 20) | (t << 12) | (pi << 8) | (pt << 4) | tp)
+// Fill list with the legal moves.
+void Board::generate_moves(S_MOVELIST& list)
+{
+	generate_to(list, ~occupancy[turn]);
+}
+
+// Fill list with the legal captures only, as searched by quiesce.
+void Board::generate_captures(S_MOVELIST& list)
+{
+	generate_to(list, occupancy[turn ^ 1]);
+}
 
-std::vector<S_MOVE> Board::generate_moves()
+// Fill list with the legal non-captures only.
+void Board::generate_quiets(S_MOVELIST& list)
 {
-	std::vector<S_MOVE> legal_moves;
-	std::vector<S_MOVE> pseudo_moves = generate_pseudo_moves();
+	generate_to(list, ~occupied);
+}
 
-	for (S_MOVE move : pseudo_moves)
+// Fill list with the legal moves landing on the target squares. Checkers
+// and pinned pieces are found once up front, so each move is legal by
+// construction and never has to be played and taken back to test it.
+void Board::generate_to(S_MOVELIST& list, u64 targets)
+{
+	list.count = 0;
+
+	int king_sq = king_square(turn);
+	u64 checkers = attackers_to(king_sq, occupied) & occupancy[turn ^ 1];
+	u64 pinned = pinned_pieces(king_sq);
+
+	if (checkers)
 	{
-		make_move(move.move);
-		switch_turn();
+		generate_evasions(list, targets, king_sq, checkers, pinned);
+		return;
+	}
 
-		if (!in_check()) legal_moves.push_back(move);
+	generate_piece_moves(list, targets, pinned, king_sq);
+	generate_king_moves(list, targets, king_sq);
+	generate_castling(list, targets);
+}
 
-		switch_turn();
-		undo_last_move();
+// Out of check the king may step to any safe square, and with a single
+// checker the other pieces may capture it or block the line it checks on.
+void Board::generate_evasions(S_MOVELIST& list, u64 targets, int king_sq, u64 checkers, u64 pinned)
+{
+	generate_king_moves(list, targets, king_sq);
+
+	// Double check, only the king can move
+	if (checkers & (checkers - 1)) return;
+
+	int checker = lsb(checkers);
+	generate_piece_moves(list, targets & (BetweenBB[king_sq][checker] | checkers), pinned, king_sq);
+}
+
+// Push a pawn move, expanding it into the four promotions when the pawn
+// reaches the last rank. A promotion scores the value of the new piece on
+// top of anything it captures.
+void Board::add_pawn_moves(S_MOVELIST& list, int from, int to, int flag)
+{
+	int pawn = squares[from];
+	int captured = squares[to];
+	int score = captured == Empty ? 0 : mvv_lva_scores[captured][pawn];
+
+	if (ROW_OF(to) != 0 && ROW_OF(to) != 7)
+	{
+		list.moves[list.count++] = { createMove(from, to, pawn, captured, flag), score };
+		return;
 	}
 
-	return legal_moves;
+	for (int promoted = pawn + 4; promoted > pawn; --promoted)
+	{
+		list.moves[list.count++] = { createPromotion(from, to, pawn, captured, flag, promoted), score + VICTIM_SCORE[promoted] };
+	}
 }
 
-std::vector<S_MOVE> Board::generate_pseudo_moves()
+// Push a move for every target in the set, scoring captures by MVV-LVA.
+void Board::add_moves(S_MOVELIST& list, int from, int piece, u64 targets)
 {
-	std::vector<S_MOVE> moves;
-	for (int pos = 0; pos < squares.size(); ++pos) {
-		int piece = squares[pos];
+	while (targets)
+	{
+		int to = pop_lsb(targets);
+		int captured = squares[to];
 
-		if ((pos & 0x88) != 0 || get_color(piece) != turn) continue;
+		if (captured == Empty)
+			list.moves[list.count++] = { createMove(from, to, piece, Empty, FLAG_QUIET), 0 };
+		else
+			list.moves[list.count++] = { createMove(from, to, piece, captured, FLAG_CAPTURE), mvv_lva_scores[captured][piece] };
+	}
+}
 
-		// Pawn Move Generation
-		if (piece == WhitePawn)
-		{
-			int dest = pos + N;
-			if ((dest & 0x88) == 0) {
-				if (squares[dest] == Empty) {
-					moves.push_back({ (pos << 20) | ((pos + N) << 12) | (squares[pos] << 8) | (squares[pos + N] << 4) | 0, 0 });
-
-					dest = pos + N + N;
-					if ((dest & 0x88) == 0 && floor(pos / 16) == 6) {
-						if (squares[dest] == Empty) {
-							moves.push_back({ (pos << 20) | ((pos + N + N) << 12) | (WhitePawn << 8) | (squares[pos + N + N] << 4) | 0, 0 });
-						}
-					}
-				}
-			}
+// Moves for every piece but the king, restricted to the target squares.
+// A pinned piece may only move along the line between its king and the
+// pinning slider.
+void Board::generate_piece_moves(S_MOVELIST& list, u64 targets, u64 pinned, int king_sq)
+{
+	u64 them = occupancy[turn ^ 1];
+	u64 empty = ~occupied;
 
-			dest = pos + N + E;
-			if ((dest & 0x88) == 0) {
-				if (get_color(squares[pos + N + E]) == Black && ((pos + N + E) & 0x88) == 0) {
-					moves.push_back({ (pos << 20) | ((pos + N + E)) << 12 | (WhitePawn << 8) | (squares[pos + N + E] << 4) | 1, mvv_lva_scores[squares[pos + N + E]][WhitePawn]});
-				}
-			}
+	// Pawn Move Generation
+	int pawn = turn == White ? WhitePawn : BlackPawn;
+	int push = turn == White ? -8 : 8;
+	u64 start_row = turn == White ? Row2BB : Row7BB;
 
-			dest = pos + N + W;
-			if ((dest & 0x88) == 0)
-			{
-				if (get_color(squares[pos + N + W]) == Black && ((pos + N + W) & 0x88) == 0) {
-					moves.push_back({(pos << 20) | ((pos + N + W)) << 12 | (WhitePawn << 8) | (squares[pos + N + W] << 4) | 1, mvv_lva_scores[squares[pos + N + W]][WhitePawn]});
-				}
-			}
-		}
+	for (int n = 0; n < piece_count[pawn]; ++n)
+	{
+		int from = piece_list[pawn][n];
+		int dest = from + push;
+		u64 allowed = targets;
+		if (pinned & BIT(from)) allowed &= LineBB[king_sq][from];
 
-		else if (piece == BlackPawn)
+		if (empty & BIT(dest))
 		{
-			int dest = pos + S;
-			if ((dest & 0x88) == 0) {
-				if (squares[dest] == Empty) {
-					moves.push_back({(pos << 20) | (dest << 12) | (squares[pos] << 8) | (squares[dest] << 4) | 0, 0 });
-					dest = pos + S + S;
-					if ((dest & 0x88) == 0 && floor(pos / 16) == 1) {
-						if (squares[dest] == Empty) {
-							moves.push_back({ (pos << 20) | ((dest) << 12) | (BlackPawn << 8) | (squares[dest] << 4) | 0, 0 });
-						}
-					}
-				}
-			}
-
-			dest = pos + S + E;
-			if ((dest & 0x88) == 0) {
-				if (get_color(squares[pos + S + E]) == White) {
-					moves.push_back({(pos << 20) | ((pos + S + E)) << 12 | (BlackPawn << 8) | (squares[pos + S + E] << 4) | 1, mvv_lva_scores[squares[pos + S + E]][BlackPawn]});
-				}
+			if (allowed & BIT(dest))
+			{
+				add_pawn_moves(list, from, dest, FLAG_QUIET);
 			}
 
-			dest = pos + S + W;
-			if ((dest & 0x88) == 0)
+			if ((start_row & BIT(from)) && (empty & allowed & BIT(dest + push)))
 			{
-				if (get_color(squares[pos + S + W]) == White) {
-					moves.push_back({(pos << 20) | ((pos + S + W)) << 12 | (BlackPawn << 8) | (squares[pos + S + W] << 4) | 1, mvv_lva_scores[squares[pos + S + W]][BlackPawn]});
-				}
+				list.moves[list.count++] = { createMove(from, dest + push, pawn, Empty, FLAG_DOUBLE_PUSH), 0 };
 			}
 		}
 
-		// King Move Generation
-		if (piece == WhiteKing || piece == BlackKing) {
-			for (int direction : KingDirections)
-			{
-				int dest = pos + direction;
-				if ((dest & 0x88) == 0 && get_color(squares[dest]) != turn && !is_square_attacked(dest, ~turn)) {
-					moves.push_back({ (pos << 20) | ((dest)) << 12 | (piece << 8) | (squares[dest] << 4) | 0, mvv_lva_scores[squares[dest]][piece] });
-				}
-			}
+		u64 captures = PawnAttacks[turn][from] & them & allowed;
+		while (captures)
+		{
+			add_pawn_moves(list, from, pop_lsb(captures), FLAG_CAPTURE);
 		}
+	}
 
-		// Knight Move Generation
-		if (piece == WhiteKnight || piece == BlackKnight) {
-			for (int direction : KnightDirections)
+	if (en_pas != NO_SQUARE) generate_en_passant(list, targets, king_sq);
+
+	// Knight, Bishop, Rook and Queen Move Generation
+	for (int piece = pawn + 1; piece <= pawn + 4; ++piece)
+	{
+		for (int n = 0; n < piece_count[piece]; ++n)
+		{
+			int from = piece_list[piece][n];
+			u64 attacks;
+
+			switch (piece - pawn)
 			{
-				int dest = pos + direction;
-				if ((dest & 0x88) == 0 && get_color(squares[dest]) != turn) {
-					moves.push_back({(pos << 20) | ((dest)) << 12 | (piece << 8) | (squares[dest] << 4) | 0, mvv_lva_scores[squares[dest]][piece]});
-				}
+			case WhiteKnight: attacks = KnightAttacks[from]; break;
+			case WhiteBishop: attacks = bishop_attacks(from, occupied); break;
+			case WhiteRook: attacks = rook_attacks(from, occupied); break;
+			default: attacks = bishop_attacks(from, occupied) | rook_attacks(from, occupied); break;
 			}
-		}
 
-		// Rook + Partial Queen Move Generation
-		if (piece == WhiteRook || piece == WhiteQueen || piece == BlackRook || piece == BlackQueen) {
-			for (int direction : RookDirections) {
-				int dest = pos + direction;
-				while ((dest & 0x88) == 0 && get_color(squares[dest]) != turn) {
-					moves.push_back({(pos << 20) | ((dest) << 12) | (piece << 8) | (squares[dest] << 4) | 0, mvv_lva_scores[squares[dest]][piece]});
-					if (squares[dest] != Empty) break;
-					dest += direction;
-				}
-			}
-		}
+			attacks &= targets;
+			if (pinned & BIT(from)) attacks &= LineBB[king_sq][from];
 
-		// Bishop + Partial Queen Move Generation
-		if (piece == WhiteBishop || piece == WhiteQueen || piece == BlackBishop || piece == BlackQueen) {
-			for (int direction : BishopDirections) {
-				int dest = pos + direction;
-				while ((dest & 0x88) == 0 && get_color(squares[dest]) != turn) {
-					moves.push_back({(pos << 20) | ((dest) << 12) | (piece << 8) | (squares[dest] << 4) | 0, mvv_lva_scores[squares[dest]][piece]});
-					if (squares[dest] != Empty) break;
-					dest += direction;
-				}
-			}
+			add_moves(list, from, piece, attacks);
 		}
 	}
-	return moves;
 }
 
-bool Board::is_square_attacked(int pos, int attacker) {
-	if (attacker == Black)
+// En passant is the one move that removes a piece from a square other
+// than its destination, which can expose the king along a rank, so each
+// candidate is checked against the occupancy after the capture. It counts
+// as a capture of the pawn beside the destination, which is the square the
+// target mask has to cover.
+void Board::generate_en_passant(S_MOVELIST& list, u64 targets, int king_sq)
+{
+	int pawn = turn == White ? WhitePawn : BlackPawn;
+	int enemy_pawn = turn == White ? BlackPawn : WhitePawn;
+	int captured_sq = en_pas + (turn == White ? 8 : -8);
+
+	if (!(targets & BIT(captured_sq))) return;
+
+	u64 them = occupancy[turn ^ 1] ^ BIT(captured_sq);
+	u64 attackers = PawnAttacks[turn ^ 1][en_pas] & pieces[pawn];
+	while (attackers)
 	{
-		if (((pos + N + E) & 0x88) == 0) {
-			if (squares[pos + N + E] == BlackPawn) return true;
-		}
-		if (((pos + N + W) & 0x88) == 0) {
-			if (squares[pos + N + W] == BlackPawn) return true;
-		}
+		int from = pop_lsb(attackers);
+		u64 occ = (occupied ^ BIT(from) ^ BIT(captured_sq)) | BIT(en_pas);
+
+		if (attackers_to(king_sq, occ) & them) continue;
+
+		list.moves[list.count++] = { createMove(from, en_pas, pawn, enemy_pawn, FLAG_EN_PASSANT), mvv_lva_scores[enemy_pawn][pawn] };
 	}
+}
 
-	else if (attacker == White)
+// Castling, only generated out of check. The king may not pass through
+// or land on an attacked square, and every square between king and rook
+// must be empty.
+void Board::generate_castling(S_MOVELIST& list, u64 targets)
+{
+	int king = turn == White ? WhiteKing : BlackKing;
+	int king_side = turn == White ? WhiteKingSide : BlackKingSide;
+	int queen_side = turn == White ? WhiteQueenSide : BlackQueenSide;
+	int from = turn == White ? 60 : 4;
+
+	if ((castling & king_side) && (targets & BIT(from + 2)) &&
+		!(occupied & (BIT(from + 1) | BIT(from + 2))) &&
+		!is_square_attacked(from + 1, turn ^ 1) && !is_square_attacked(from + 2, turn ^ 1))
 	{
-		if (((pos + S + E) & 0x88) == 0) {
-			if (squares[pos + S + E] == WhitePawn) return true;
-		}
-		if (((pos + S + W) & 0x88) == 0) {
-			if (squares[pos + S + W] == WhitePawn) return true;
-		}
+		list.moves[list.count++] = { createMove(from, from + 2, king, Empty, FLAG_CASTLE), 0 };
 	}
 
-	for (int direction : KnightDirections) {
-		if (((pos + direction) & 0x88) != 0) continue;
-		int piece = squares[pos + direction];
-		if ((piece == WhiteKnight || piece == BlackKnight) && get_color(piece) == attacker) return true;
+	if ((castling & queen_side) && (targets & BIT(from - 2)) &&
+		!(occupied & (BIT(from - 1) | BIT(from - 2) | BIT(from - 3))) &&
+		!is_square_attacked(from - 1, turn ^ 1) && !is_square_attacked(from - 2, turn ^ 1))
+	{
+		list.moves[list.count++] = { createMove(from, from - 2, king, Empty, FLAG_CASTLE), 0 };
 	}
+}
 
-	for (int direction : KingDirections) {
-		if (((pos + direction) & 0x88) != 0) continue;
-		int piece = squares[pos + direction];
-		if ((piece == WhiteKing || piece == BlackKing) && get_color(piece) == attacker) return true;
-	}
+// King Move Generation. Attacks on each target square are tested with the
+// king lifted off the board, so it cannot retreat along a checking line.
+void Board::generate_king_moves(S_MOVELIST& list, u64 targets, int king_sq)
+{
+	int king = squares[king_sq];
+	u64 them = occupancy[turn ^ 1];
+	u64 without_king = occupied ^ BIT(king_sq);
+	targets &= KingAttacks[king_sq] & ~occupancy[turn];
 
-	for (int direction : RookDirections) {
-		int index = pos;
-		while (((index + direction) & 0x88) == 0) {
-			index += direction;
-			int piece = squares[index];
+	while (targets)
+	{
+		int to = pop_lsb(targets);
+		if (attackers_to(to, without_king) & them) continue;
 
-			if (piece != Empty) {
-				if ((piece == WhiteRook || piece == BlackRook || piece == WhiteQueen || piece == BlackQueen) && get_color(piece) == attacker) return true;
-				break;
-			}
-		}
+		add_moves(list, king_sq, king, BIT(to));
 	}
+}
 
-	for (int direction : BishopDirections) {
-		int index = pos;
-		while (((index + direction) & 0x88) == 0) {
-			index += direction;
-			int piece = squares[index];
+// Pieces of the side to move that shield their own king from an enemy
+// slider.
+u64 Board::pinned_pieces(int king_sq)
+{
+	int offset = turn == White ? BlackPawn : 0;
+	u64 queens = pieces[WhiteQueen + offset];
+	u64 snipers = (rook_attacks(king_sq, 0ULL) & (pieces[WhiteRook + offset] | queens)) |
+		(bishop_attacks(king_sq, 0ULL) & (pieces[WhiteBishop + offset] | queens));
 
-			if (piece != Empty) {
-				if ((piece == WhiteBishop || piece == BlackBishop || piece == WhiteQueen || piece == BlackQueen) && get_color(piece) == attacker) return true;
-				break;
-			}
-		}
+	u64 pinned = 0ULL;
+	while (snipers)
+	{
+		u64 between = BetweenBB[king_sq][pop_lsb(snipers)] & occupied;
+		if (between && !(between & (between - 1))) pinned |= between & occupancy[turn];
 	}
+	return pinned;
+}
+
+// Every piece of either colour attacking pos, given the occupancy.
+u64 Board::attackers_to(int pos, u64 occ)
+{
+	u64 queens = pieces[WhiteQueen] | pieces[BlackQueen];
+
+	return (PawnAttacks[Black][pos] & pieces[WhitePawn]) |
+		(PawnAttacks[White][pos] & pieces[BlackPawn]) |
+		(KnightAttacks[pos] & (pieces[WhiteKnight] | pieces[BlackKnight])) |
+		(KingAttacks[pos] & (pieces[WhiteKing] | pieces[BlackKing])) |
+		(bishop_attacks(pos, occ) & (pieces[WhiteBishop] | pieces[BlackBishop] | queens)) |
+		(rook_attacks(pos, occ) & (pieces[WhiteRook] | pieces[BlackRook] | queens));
+}
+
+bool Board::is_square_attacked(int pos, int attacker) {
+	int offset = attacker == White ? 0 : BlackPawn;
+
+	// A pawn attacks pos exactly when a pawn of the other colour standing
+	// on pos would attack the pawn's square.
+	if (PawnAttacks[attacker ^ 1][pos] & pieces[WhitePawn + offset]) return true;
+	if (KnightAttacks[pos] & pieces[WhiteKnight + offset]) return true;
+	if (KingAttacks[pos] & pieces[WhiteKing + offset]) return true;
+
+	u64 queens = pieces[WhiteQueen + offset];
+	if (bishop_attacks(pos, occupied) & (pieces[WhiteBishop + offset] | queens)) return true;
+	if (rook_attacks(pos, occupied) & (pieces[WhiteRook + offset] | queens)) return true;
 
 	return false;
 }
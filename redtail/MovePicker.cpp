@@ -0,0 +1,80 @@
+#include "MovePicker.h"
+
+MovePicker::MovePicker(Board* board, int tt_move, bool captures_only, SearchContext* context)
+{
+	this->board = board;
+	this->context = context;
+	this->tt_move = tt_move;
+	this->captures_only = captures_only;
+
+	list.count = 0;
+	index = 0;
+	stage = tt_move != 0 && !captures_only ? PICK_TT_MOVE : PICK_INIT_CAPTURES;
+}
+
+// Selection step: swap the highest scoring remaining move to the front of
+// the unsearched part of the list and return it.
+int MovePicker::pick_best()
+{
+	int best = index;
+	for (int i = index + 1; i < list.count; ++i)
+	{
+		if (list.moves[i].score > list.moves[best].score) best = i;
+	}
+
+	S_MOVE move = list.moves[best];
+	list.moves[best] = list.moves[index];
+	list.moves[index++] = move;
+	return move.move;
+}
+
+int MovePicker::next_move()
+{
+	int move;
+
+	switch (stage)
+	{
+	case PICK_TT_MOVE:
+		++stage;
+		return tt_move;
+
+	case PICK_INIT_CAPTURES:
+		board->generate_captures(list);
+		index = 0;
+		++stage;
+		// fall through
+
+	case PICK_CAPTURES:
+		while (index < list.count)
+		{
+			move = pick_best();
+			if (move != tt_move) return move;
+		}
+		if (captures_only)
+		{
+			stage = PICK_DONE;
+			return 0;
+		}
+		++stage;
+		// fall through
+
+	case PICK_INIT_QUIETS:
+		board->generate_quiets(list);
+		if (context != NULL) context->score_quiets(list);
+		index = 0;
+		++stage;
+		// fall through
+
+	case PICK_QUIETS:
+		while (index < list.count)
+		{
+			move = pick_best();
+			if (move != tt_move) return move;
+		}
+		++stage;
+		// fall through
+
+	default:
+		return 0;
+	}
+}
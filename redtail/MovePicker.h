@@ -0,0 +1,39 @@
+#include "Board.h"
+#include "Search.h"
+#pragma once
+
+// Stages the move picker walks through, in order
+enum {
+    PICK_TT_MOVE,
+    PICK_INIT_CAPTURES,
+    PICK_CAPTURES,
+    PICK_INIT_QUIETS,
+    PICK_QUIETS,
+    PICK_DONE
+};
+
+// Hands out the moves of a position one at a time, best first: the hash
+// move, then captures by MVV-LVA, then quiet moves, ordered by the search
+// context's killer, countermove and history tables when one is given.
+// Each stage is only generated once the previous one is used up, so a
+// node that cuts off early never generates or sorts the rest.
+class MovePicker
+{
+private:
+    Board* board;
+    SearchContext* context;
+    S_MOVELIST list;
+    int index;
+    int stage;
+    int tt_move;
+    bool captures_only;
+
+    int pick_best();
+
+public:
+    // tt_move must be 0 or a legal move here, as Board::expand_move returns
+    MovePicker(Board* board, int tt_move, bool captures_only, SearchContext* context = NULL);
+
+    // Next move to search, or 0 when there are none left
+    int next_move();
+};
@@ -0,0 +1,204 @@
+#include <fstream>
+#include <vector>
+#include <cstring>
+#include <algorithm>
+#include "Board.h"
+#include "Nnue.h"
+
+// Vector kernels for the int16 accumulator work: AVX2 when the compiler
+// targets it, SSE2 on any x86-64, plain loops otherwise.
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define NNUE_SIMD
+typedef __m256i vec_t;
+const int VEC_WIDTH = 16;
+inline vec_t vec_load(const int16_t* p) { return _mm256_loadu_si256((const __m256i*)p); }
+inline void vec_store(int16_t* p, vec_t v) { _mm256_storeu_si256((__m256i*)p, v); }
+inline vec_t vec_set16(int x) { return _mm256_set1_epi16((short)x); }
+inline vec_t vec_add16(vec_t a, vec_t b) { return _mm256_add_epi16(a, b); }
+inline vec_t vec_sub16(vec_t a, vec_t b) { return _mm256_sub_epi16(a, b); }
+inline vec_t vec_min16(vec_t a, vec_t b) { return _mm256_min_epi16(a, b); }
+inline vec_t vec_max16(vec_t a, vec_t b) { return _mm256_max_epi16(a, b); }
+inline vec_t vec_madd16(vec_t a, vec_t b) { return _mm256_madd_epi16(a, b); }
+inline vec_t vec_add32(vec_t a, vec_t b) { return _mm256_add_epi32(a, b); }
+inline int vec_sum32(vec_t v)
+{
+	__m128i s = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+	s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0x4e));
+	s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0xb1));
+	return _mm_cvtsi128_si32(s);
+}
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define NNUE_SIMD
+typedef __m128i vec_t;
+const int VEC_WIDTH = 8;
+inline vec_t vec_load(const int16_t* p) { return _mm_loadu_si128((const __m128i*)p); }
+inline void vec_store(int16_t* p, vec_t v) { _mm_storeu_si128((__m128i*)p, v); }
+inline vec_t vec_set16(int x) { return _mm_set1_epi16((short)x); }
+inline vec_t vec_add16(vec_t a, vec_t b) { return _mm_add_epi16(a, b); }
+inline vec_t vec_sub16(vec_t a, vec_t b) { return _mm_sub_epi16(a, b); }
+inline vec_t vec_min16(vec_t a, vec_t b) { return _mm_min_epi16(a, b); }
+inline vec_t vec_max16(vec_t a, vec_t b) { return _mm_max_epi16(a, b); }
+inline vec_t vec_madd16(vec_t a, vec_t b) { return _mm_madd_epi16(a, b); }
+inline vec_t vec_add32(vec_t a, vec_t b) { return _mm_add_epi32(a, b); }
+inline int vec_sum32(vec_t s)
+{
+	s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0x4e));
+	s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0xb1));
+	return _mm_cvtsi128_si32(s);
+}
+#endif
+
+#ifdef NNUE_SIMD
+static_assert(NNUE_HIDDEN % VEC_WIDTH == 0, "the hidden layer must fill whole vectors");
+#endif
+
+static int16_t FeatureWeights[NNUE_INPUTS][NNUE_HIDDEN];
+static int16_t FeatureBiases[NNUE_HIDDEN];
+static int16_t OutputWeights[2 * NNUE_HIDDEN];
+static int OutputBias;
+
+static bool loaded = false;
+
+static const size_t NET_VALUES = NNUE_INPUTS * NNUE_HIDDEN + NNUE_HIDDEN + 2 * NNUE_HIDDEN + 1;
+
+// Trainers may pad the file out, but never by more than a cache line
+static const std::streamsize MAX_PADDING = 64;
+
+bool nnue_load(const std::string& path)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file) return false;
+
+	// Read straight into int16s, which assumes a little-endian host
+	std::vector<int16_t> data(NET_VALUES);
+	file.read((char*)data.data(), NET_VALUES * sizeof(int16_t));
+	if ((size_t)file.gcount() != NET_VALUES * sizeof(int16_t)) return false;
+
+	char padding[MAX_PADDING + 1];
+	file.read(padding, sizeof(padding));
+	if (file.gcount() > MAX_PADDING) return false;
+
+	const int16_t* p = data.data();
+	memcpy(FeatureWeights, p, sizeof(FeatureWeights));
+	p += NNUE_INPUTS * NNUE_HIDDEN;
+	memcpy(FeatureBiases, p, sizeof(FeatureBiases));
+	p += NNUE_HIDDEN;
+	memcpy(OutputWeights, p, sizeof(OutputWeights));
+	p += 2 * NNUE_HIDDEN;
+	OutputBias = *p;
+
+	loaded = true;
+	return true;
+}
+
+void nnue_unload()
+{
+	loaded = false;
+}
+
+bool nnue_loaded()
+{
+	return loaded;
+}
+
+// Input index of a piece on a square as seen by one side. Inputs run from
+// a1 in the usual order, so White flips the a8-first board numbering and
+// Black, seeing the board upside down, keeps it.
+static int feature(int perspective, int piece, int sq)
+{
+	if (perspective == White) return piece * 64 + (sq ^ 56);
+	return ((piece + 6) % 12) * 64 + sq;
+}
+
+static void add_weights(int16_t* acc, const int16_t* weights)
+{
+#ifdef NNUE_SIMD
+	for (int i = 0; i < NNUE_HIDDEN; i += VEC_WIDTH) vec_store(acc + i, vec_add16(vec_load(acc + i), vec_load(weights + i)));
+#else
+	for (int i = 0; i < NNUE_HIDDEN; ++i) acc[i] += weights[i];
+#endif
+}
+
+static void sub_weights(int16_t* acc, const int16_t* weights)
+{
+#ifdef NNUE_SIMD
+	for (int i = 0; i < NNUE_HIDDEN; i += VEC_WIDTH) vec_store(acc + i, vec_sub16(vec_load(acc + i), vec_load(weights + i)));
+#else
+	for (int i = 0; i < NNUE_HIDDEN; ++i) acc[i] -= weights[i];
+#endif
+}
+
+// A quiet move adds one input and removes another in a single pass
+static void add_sub_weights(int16_t* acc, const int16_t* added, const int16_t* removed)
+{
+#ifdef NNUE_SIMD
+	for (int i = 0; i < NNUE_HIDDEN; i += VEC_WIDTH)
+		vec_store(acc + i, vec_sub16(vec_add16(vec_load(acc + i), vec_load(added + i)), vec_load(removed + i)));
+#else
+	for (int i = 0; i < NNUE_HIDDEN; ++i) acc[i] += added[i] - removed[i];
+#endif
+}
+
+void nnue_refresh(S_ACCUMULATOR& acc, const int squares[64])
+{
+	for (int side = White; side <= Black; ++side)
+	{
+		memcpy(acc.values[side], FeatureBiases, sizeof(FeatureBiases));
+		for (int sq = 0; sq < 64; ++sq)
+		{
+			if (squares[sq] <= BlackKing) add_weights(acc.values[side], FeatureWeights[feature(side, squares[sq], sq)]);
+		}
+	}
+}
+
+void nnue_add(S_ACCUMULATOR& acc, int piece, int sq)
+{
+	add_weights(acc.values[White], FeatureWeights[feature(White, piece, sq)]);
+	add_weights(acc.values[Black], FeatureWeights[feature(Black, piece, sq)]);
+}
+
+void nnue_remove(S_ACCUMULATOR& acc, int piece, int sq)
+{
+	sub_weights(acc.values[White], FeatureWeights[feature(White, piece, sq)]);
+	sub_weights(acc.values[Black], FeatureWeights[feature(Black, piece, sq)]);
+}
+
+void nnue_move(S_ACCUMULATOR& acc, int piece, int from, int to)
+{
+	add_sub_weights(acc.values[White], FeatureWeights[feature(White, piece, to)], FeatureWeights[feature(White, piece, from)]);
+	add_sub_weights(acc.values[Black], FeatureWeights[feature(Black, piece, to)], FeatureWeights[feature(Black, piece, from)]);
+}
+
+// Sum of clipped-ReLU activations times the output weights
+static int crelu_dot(const int16_t* acc, const int16_t* weights)
+{
+#ifdef NNUE_SIMD
+	vec_t zero = vec_set16(0);
+	vec_t ceiling = vec_set16(NNUE_QA);
+	vec_t sum = vec_set16(0);
+	for (int i = 0; i < NNUE_HIDDEN; i += VEC_WIDTH)
+	{
+		vec_t activation = vec_min16(vec_max16(vec_load(acc + i), zero), ceiling);
+		sum = vec_add32(sum, vec_madd16(activation, vec_load(weights + i)));
+	}
+	return vec_sum32(sum);
+#else
+	int sum = 0;
+	for (int i = 0; i < NNUE_HIDDEN; ++i) sum += std::min(std::max((int)acc[i], 0), NNUE_QA) * weights[i];
+	return sum;
+#endif
+}
+
+// Network scores are kept well clear of the mate range
+static const int MAX_NNUE_SCORE = 10000;
+
+int nnue_evaluate(const S_ACCUMULATOR& acc, int turn)
+{
+	long long sum = (long long)crelu_dot(acc.values[turn], OutputWeights) +
+		crelu_dot(acc.values[turn ^ 1], OutputWeights + NNUE_HIDDEN) + OutputBias;
+
+	int score = (int)(sum * NNUE_SCALE / (NNUE_QA * NNUE_QB));
+	return std::max(-MAX_NNUE_SCORE, std::min(score, MAX_NNUE_SCORE));
+}
@@ -0,0 +1,39 @@
+#include <cstdint>
+#include <string>
+#pragma once
+
+// Optional neural network evaluation, (768 -> NNUE_HIDDEN) x 2 -> 1. Each
+// side has its own first-layer accumulator over the 768 piece-square
+// inputs, seen from that side: its own pieces first and the board flipped
+// for Black. The output layer reads the side to move's half first.
+const int NNUE_INPUTS = 768;
+const int NNUE_HIDDEN = 256;
+
+// Quantisation: first layer weights scaled by NNUE_QA, output weights by
+// NNUE_QB, and the output scaled to centipawns by NNUE_SCALE.
+const int NNUE_QA = 255;
+const int NNUE_QB = 64;
+const int NNUE_SCALE = 400;
+
+// First-layer output for both perspectives, indexed by colour
+typedef struct {
+    int16_t values[2][NNUE_HIDDEN];
+} S_ACCUMULATOR;
+
+// Load a network of little-endian int16 values: feature weights, feature
+// biases, output weights and the output bias, in that order. On failure
+// the previous network, if any, stays in use.
+bool nnue_load(const std::string& path);
+void nnue_unload();
+bool nnue_loaded();
+
+// Compute the accumulator from scratch for the pieces on squares
+void nnue_refresh(S_ACCUMULATOR& acc, const int squares[64]);
+
+// Incremental updates for a piece appearing, disappearing or moving
+void nnue_add(S_ACCUMULATOR& acc, int piece, int sq);
+void nnue_remove(S_ACCUMULATOR& acc, int piece, int sq);
+void nnue_move(S_ACCUMULATOR& acc, int piece, int from, int to);
+
+// Score in centipawns from the side to move's point of view
+int nnue_evaluate(const S_ACCUMULATOR& acc, int turn);
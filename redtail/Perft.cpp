@@ -0,0 +1,166 @@
+#include <iostream>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <vector>
+#include "Perft.h"
+
+// Leaf node count, counting the moves of the last ply in bulk instead of
+// playing them.
+u64 Board::perft(int depth) {
+	S_MOVELIST list;
+	generate_moves(list);
+
+	if (depth <= 1) return depth == 1 ? list.count : 1;
+
+	u64 nodes = 0;
+	for (int i = 0; i < list.count; ++i)
+	{
+		make_move(list.moves[i].move);
+		nodes += perft(depth - 1);
+		undo_last_move();
+	}
+
+	return nodes;
+}
+
+// Same as perft, but takes moves back by copying the saved position over
+// the board instead of calling undo_last_move.
+u64 Board::perft_copy(int depth) {
+	S_MOVELIST list;
+	generate_moves(list);
+
+	if (depth <= 1) return depth == 1 ? list.count : 1;
+
+	S_BOARD_STATE state;
+	save_state(state);
+	u64 nodes = 0;
+
+	for (int i = 0; i < list.count; ++i)
+	{
+		make_move(list.moves[i].move);
+		nodes += perft_copy(depth - 1);
+		restore_state(state);
+		--hisPly;
+	}
+
+	return nodes;
+}
+
+// Perft hash table, shared by all perft threads. Each entry stores the
+// node count and depth packed into data, and the position key XORed with
+// data, so a torn write from another thread simply fails to match.
+typedef struct
+{
+    std::atomic<u64> check;
+    std::atomic<u64> data;
+} PERFT_ENTRY;
+
+static const int PERFT_HASH_ENTRIES = 1 << 20;
+static PERFT_ENTRY* perft_table = NULL;
+
+static bool probe_perft_table(u64 key, int depth, u64& nodes)
+{
+	PERFT_ENTRY& entry = perft_table[key & (PERFT_HASH_ENTRIES - 1)];
+	u64 data = entry.data.load(std::memory_order_relaxed);
+	u64 check = entry.check.load(std::memory_order_relaxed);
+
+	if ((check ^ data) != key || (int)(data & 0xff) != depth) return false;
+
+	nodes = data >> 8;
+	return true;
+}
+
+static void store_perft_table(u64 key, int depth, u64 nodes)
+{
+	PERFT_ENTRY& entry = perft_table[key & (PERFT_HASH_ENTRIES - 1)];
+	u64 data = (nodes << 8) | (u64)depth;
+
+	entry.check.store(key ^ data, std::memory_order_relaxed);
+	entry.data.store(data, std::memory_order_relaxed);
+}
+
+static u64 perft_hashed(Board& board, int depth)
+{
+	// The last ply is counted in bulk, without a table lookup
+	if (depth <= 1) return board.perft(depth);
+
+	u64 nodes = 0;
+	if (probe_perft_table(board.position_key(), depth, nodes)) return nodes;
+
+	S_MOVELIST list;
+	board.generate_moves(list);
+
+	for (int i = 0; i < list.count; ++i)
+	{
+		board.make_move(list.moves[i].move);
+		nodes += perft_hashed(board, depth - 1);
+		board.undo_last_move();
+	}
+
+	store_perft_table(board.position_key(), depth, nodes);
+	return nodes;
+}
+
+u64 perft_divide(Board& board, int depth, int threads)
+{
+	if (threads < 1) threads = 1;
+
+	auto start = std::chrono::steady_clock::now();
+
+	// Start every run from an empty table so timings are comparable
+	if (perft_table == NULL) perft_table = new PERFT_ENTRY[PERFT_HASH_ENTRIES];
+	for (int i = 0; i < PERFT_HASH_ENTRIES; ++i)
+	{
+		perft_table[i].check.store(0, std::memory_order_relaxed);
+		perft_table[i].data.store(0, std::memory_order_relaxed);
+	}
+
+	S_MOVELIST list;
+	board.generate_moves(list);
+
+	// Depth 0 counts the root alone, with no moves to divide it by
+	if (depth <= 0) list.count = 0;
+
+	S_BOARD_STATE root;
+	board.save_state(root);
+
+	// Workers take root moves from a shared counter until none are left
+	std::vector<u64> counts(list.count, 1);
+	std::atomic<int> next_move(0);
+
+	auto worker = [&]() {
+		Board thread_board;
+		thread_board.restore_state(root);
+
+		int i;
+		while ((i = next_move++) < list.count)
+		{
+			if (depth <= 1) continue;
+
+			thread_board.make_move(list.moves[i].move);
+			counts[i] = perft_hashed(thread_board, depth - 1);
+			thread_board.undo_last_move();
+		}
+	};
+
+	std::vector<std::thread> pool;
+	for (int t = 0; t < threads; ++t) pool.push_back(std::thread(worker));
+	for (std::thread& thread : pool) thread.join();
+
+	u64 total = depth <= 0 ? 1 : 0;
+	for (int i = 0; i < list.count; ++i)
+	{
+		std::cout << board.get_move_ref(list.moves[i].move) << ": " << counts[i] << std::endl;
+		total += counts[i];
+	}
+
+	long long ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+
+	std::cout << std::endl
+		<< "Nodes: " << total << std::endl
+		<< "Time: " << ms << " ms" << std::endl
+		<< "NPS: " << (ms > 0 ? total * 1000 / ms : total) << std::endl;
+
+	return total;
+}
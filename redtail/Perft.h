@@ -0,0 +1,7 @@
+#include "Board.h"
+#pragma once
+
+// Count the leaf nodes below every root move, splitting the root moves
+// over a pool of threads that share a perft hash table. Prints the
+// per-move breakdown, the total and the speed, and returns the total.
+u64 perft_divide(Board& board, int depth, int threads);
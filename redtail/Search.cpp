@@ -0,0 +1,593 @@
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <chrono>
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+#include <mutex>
+#include "Search.h"
+#include "MovePicker.h"
+#include "TTable.h"
+#include "Threads.h"
+#include "Utils.h"
+
+// One MultiPV line of an iteration
+typedef struct {
+	int score;
+	int length;
+	int moves[Board::MAX_DEPTH];
+} S_PVLINE;
+
+#define INF 30000
+#define MATE 29900
+
+// Half-width of the first aspiration window, in centipawns, and the depth
+// from which iterations start with one.
+#define ASPIRATION_WINDOW 25
+#define ASPIRATION_DEPTH 4
+
+// Quiet move scores. Promotions keep their own score on top of the
+// largest, history scores stay below the countermove's.
+#define PROMOTION_BONUS 2000000
+#define KILLER_SCORE_1 900000
+#define KILLER_SCORE_2 800000
+#define COUNTERMOVE_SCORE 700000
+#define HISTORY_MAX 600000
+
+S_SEARCHPARAMS search_params = { 75, 225, 3, 100, 3, 80, 6 };
+
+typedef struct {
+    const char* name;
+    int* value;
+    int min;
+    int max;
+} S_SEARCHOPTION;
+
+static const S_SEARCHOPTION SEARCH_OPTIONS[] = {
+	{ "LMRBase", &search_params.lmr_base, 0, 300 },
+	{ "LMRDivisor", &search_params.lmr_divisor, 50, 1000 },
+	{ "LMRMinMoves", &search_params.lmr_min_moves, 1, 20 },
+	{ "FutilityMargin", &search_params.futility_margin, 0, 1000 },
+	{ "FutilityDepth", &search_params.futility_depth, 0, 10 },
+	{ "RFPMargin", &search_params.rfp_margin, 0, 1000 },
+	{ "RFPDepth", &search_params.rfp_depth, 0, 15 },
+};
+
+// Late move reductions in plies, by depth left and moves searched so far
+static const int LMR_SIZE = 64;
+static int Reductions[LMR_SIZE][LMR_SIZE];
+
+void init_reductions()
+{
+	for (int depth = 1; depth < LMR_SIZE; ++depth)
+	{
+		for (int moves = 1; moves < LMR_SIZE; ++moves)
+		{
+			Reductions[depth][moves] = (int)(search_params.lmr_base / 100.0 +
+				log(depth) * log(moves) / (search_params.lmr_divisor / 100.0));
+		}
+	}
+}
+
+void print_search_options()
+{
+	for (const S_SEARCHOPTION& option : SEARCH_OPTIONS)
+	{
+		std::cout << "option name " << option.name << " type spin default " << *option.value
+			<< " min " << option.min << " max " << option.max << std::endl;
+	}
+}
+
+bool set_search_option(const std::string& name, int value)
+{
+	for (const S_SEARCHOPTION& option : SEARCH_OPTIONS)
+	{
+		if (name != option.name) continue;
+
+		*option.value = std::max(option.min, std::min(option.max, value));
+		init_reductions();
+		return true;
+	}
+	return false;
+}
+
+// Nodes searched between polls of the clock and the stop flag, less one
+#define CHECK_INTERVAL 2047
+
+// Time kept back on every move for communication with the GUI
+#define MOVE_OVERHEAD 30
+
+int get_time_ms()
+{
+	static const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	return (int)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+void allocate_time(S_SEARCHINFO& info, int time, int inc, int movestogo)
+{
+	int available = std::max(1, time - MOVE_OVERHEAD);
+	int moves = movestogo > 0 ? std::min(movestogo, 40) : 30;
+
+	// Aim for an even share of the clock, and allow a search that is still
+	// unsettled to run up to four times over, but never past a third of
+	// what is left. The last move before the control has nothing left to
+	// save for and may take three quarters, keeping the rest in hand for
+	// delays longer than MOVE_OVERHEAD.
+	int cap = std::min(available, moves == 1 ? available * 3 / 4 : available / 3 + inc);
+	info.softtime = std::min(cap, available / moves + inc * 3 / 4);
+	info.timeset = std::min(cap, info.softtime * 4);
+}
+
+SearchContext::SearchContext(Board& board) : board(board)
+{
+	info.thread_id = 0;
+	info.depth_done = 0;
+	info.best_move = 0;
+	ply = 0;
+	pondering = false;
+	table = &TT;
+	published_nodes = 0;
+	tt_generation = 0;
+	signals.stop = false;
+	signals.ponder = false;
+	polled_signals = &signals;
+	multipv = 1;
+	excluded_count = 0;
+	eval_cache.resize(EVAL_CACHE_ENTRIES);
+
+	static std::once_flag once;
+	std::call_once(once, init_reductions);
+
+	memset(killers, 0, sizeof(killers));
+	memset(history, 0, sizeof(history));
+	memset(countermoves, 0, sizeof(countermoves));
+}
+
+void SearchContext::score_quiets(S_MOVELIST& list)
+{
+	int previous = board.last_move();
+	int counter = previous ? countermoves[MOVED_PIECE(previous)][TO_SQ(previous)] : 0;
+
+	for (int i = 0; i < list.count; ++i)
+	{
+		S_MOVE& m = list.moves[i];
+
+		if (m.score > 0) m.score += PROMOTION_BONUS;
+		else if (m.move == killers[ply][0]) m.score = KILLER_SCORE_1;
+		else if (m.move == killers[ply][1]) m.score = KILLER_SCORE_2;
+		else if (m.move == counter) m.score = COUNTERMOVE_SCORE;
+		else m.score = history[board.turn][FROM_SQ(m.move)][TO_SQ(m.move)];
+	}
+}
+
+// A quiet move caused a beta cutoff: remember it as a killer at this ply,
+// as the reply to the previous move, and credit its history more the
+// deeper the search below it.
+void SearchContext::update_quiet_stats(int move, int depth)
+{
+	if (killers[ply][0] != move)
+	{
+		killers[ply][1] = killers[ply][0];
+		killers[ply][0] = move;
+	}
+
+	int previous = board.last_move();
+	if (previous) countermoves[MOVED_PIECE(previous)][TO_SQ(previous)] = move;
+
+	int& entry = history[board.turn][FROM_SQ(move)][TO_SQ(move)];
+	entry += depth * depth;
+
+	// Keep history below the fixed scores, and let old results fade
+	if (entry > HISTORY_MAX)
+	{
+		for (int side = 0; side < 2; ++side)
+			for (int from = 0; from < 64; ++from)
+				for (int to = 0; to < 64; ++to)
+					history[side][from][to] /= 2;
+	}
+}
+
+// The clock only runs once a ponder search becomes a real one: at the
+// first check after ponderhit the start time is moved up to that moment,
+// keeping the table and the iterations already searched.
+bool SearchContext::is_pondering() {
+	if (!pondering) return false;
+	if (polled_signals->ponder.load(std::memory_order_relaxed)) return true;
+
+	pondering = false;
+	info.starttime = get_time_ms();
+	return false;
+}
+
+void SearchContext::check_up() {
+	published_nodes.store(info.nodes, std::memory_order_relaxed);
+	if (!is_pondering() && (get_time_ms() - info.starttime) > info.timeset) info.stopped = true;
+	if (polled_signals->stop.load(std::memory_order_relaxed)) info.stopped = true;
+}
+
+int SearchContext::quiesce(int alpha, int beta) {
+	if ((info.nodes & CHECK_INTERVAL) == 0) check_up();
+
+	if (info.stopped) return 0;
+
+	info.nodes++;
+	if (info.nodeset && info.nodes >= info.nodeset) info.stopped = true;
+
+	int stand_pat = evaluate();
+	if (stand_pat >= beta) return beta;
+	if (alpha < stand_pat) alpha = stand_pat;
+
+	MovePicker picker(&board, 0, true);
+	int move;
+
+	while ((move = picker.next_move()) != 0) {
+		board.make_move(move);
+		++ply;
+		int score = -quiesce(-beta, -alpha);
+		--ply;
+		board.undo_last_move();
+
+		if (score >= beta) return beta;
+		if (score > alpha) alpha = score;
+	}
+
+	return alpha;
+}
+
+int SearchContext::alpha_beta(int alpha, int beta, int depth, bool do_null) {
+	if ((info.nodes & CHECK_INTERVAL) == 0) check_up();
+
+	if (info.stopped) return 0;
+
+	int best_move = 0;
+	int old_alpha = alpha;
+
+	u64 pos_key = board.position_key();
+	int tt_move = 0;
+
+	info.nodes++;
+	if (info.nodeset && info.nodes >= info.nodeset) info.stopped = true;
+
+	TT_ENTRY stored;
+	if (table->probe(pos_key, stored, tt_generation)) {
+		// Never at the root, which has to search to report a best move
+		if (stored.depth >= depth && ply > 0) {
+			if (TT_BOUND(stored) == TT_EXACT) return stored.score;
+			if (TT_BOUND(stored) == TT_ALPHA && stored.score <= alpha) return alpha;
+			if (TT_BOUND(stored) == TT_BETA && stored.score >= beta) return beta;
+		}
+
+		// Only a node that searches needs the full move
+		tt_move = board.expand_move(stored.move);
+	}
+
+	if (depth == 0) {
+		int val = quiesce(alpha, beta);
+		table->store(pos_key, 0, val, depth, val <= alpha ? TT_ALPHA : val >= beta ? TT_BETA : TT_EXACT, tt_generation);
+		return val;
+	}
+
+	bool in_check = board.in_check();
+	bool pv_node = beta - alpha > 1;
+	int static_eval = evaluate();
+
+	// Reverse futility: this close to the leaves, a static score this far
+	// above beta is not going to be pulled back down.
+	if (!pv_node && !in_check && ply > 0 && depth <= search_params.rfp_depth &&
+		static_eval - search_params.rfp_margin * depth >= beta) {
+		return beta;
+	}
+
+	if (do_null && ply > 0 && !in_check && depth >= 4) {
+		board.make_null_move();
+		++ply;
+		int null_move_val = -alpha_beta(-beta, -beta + 1, depth - 4, false);
+		--ply;
+		board.undo_null_move();
+
+		if (info.stopped) return 0;
+		if (null_move_val >= beta) {
+			table->store(pos_key, 0, beta, depth, TT_BETA, tt_generation);
+			return beta;
+		}
+	}
+
+	// Futility: with the static score this far below alpha, quiet moves
+	// near the leaves have no realistic chance of raising it.
+	bool futile = !pv_node && !in_check && depth <= search_params.futility_depth &&
+		static_eval + search_params.futility_margin * depth <= alpha;
+
+	// A root searched with moves left out has no true score, so it must not
+	// overwrite the entry the full root search left
+	bool store = ply > 0 || excluded_count == 0;
+
+	MovePicker picker(&board, tt_move, false, this);
+	int move;
+	int moves_searched = 0;
+
+	while ((move = picker.next_move()) != 0) {
+		// Root moves already reported on an earlier MultiPV line
+		if (ply == 0 && std::find(excluded, excluded + excluded_count, move) != excluded + excluded_count) continue;
+
+		bool quiet = !board.is_capture(move) && PROMOTED_PIECE(move) == WhitePawn;
+
+		board.make_move(move);
+		bool gives_check = board.in_check();
+
+		if (futile && quiet && !gives_check && moves_searched > 0) {
+			board.undo_last_move();
+			continue;
+		}
+
+		++ply;
+
+		// Principal variation search: only the first move gets the full
+		// window. The rest are expected to fail low, which a null window
+		// proves more cheaply, and are searched again in full only when
+		// they turn out to lie inside the window.
+		int score;
+		if (moves_searched == 0) {
+			score = -alpha_beta(-beta, -alpha, depth - 1, !do_null);
+		}
+		else {
+			// Late move reductions: quiet moves this far down the ordering
+			// rarely matter and are searched shallower first, and at full
+			// depth only if they beat alpha.
+			int reduction = 0;
+			if (depth >= 3 && quiet && !in_check && !gives_check && moves_searched >= search_params.lmr_min_moves) {
+				reduction = Reductions[std::min(depth, LMR_SIZE - 1)][std::min(moves_searched, LMR_SIZE - 1)];
+				reduction = std::max(0, std::min(reduction, depth - 2));
+			}
+
+			score = -alpha_beta(-alpha - 1, -alpha, depth - 1 - reduction, !do_null);
+			if (reduction > 0 && score > alpha) score = -alpha_beta(-alpha - 1, -alpha, depth - 1, !do_null);
+			if (score > alpha && score < beta) score = -alpha_beta(-beta, -alpha, depth - 1, !do_null);
+		}
+
+		--ply;
+		board.undo_last_move();
+		++moves_searched;
+
+		if (info.stopped) return 0;
+
+		if (score > alpha) {
+			alpha = score;
+			best_move = move;
+			if (ply == 0) root_move = move;
+
+			if (score >= beta) {
+				if (moves_searched == 1) info.fhf++;
+				info.fh++;
+
+				if (quiet) update_quiet_stats(move, depth);
+
+				if (store) table->store(pos_key, PACK_MOVE(move), beta, depth, TT_BETA, tt_generation);
+				return beta;
+			}
+		}
+	}
+
+	// The best move is what the principal variation is read back from
+	if (store) table->store(pos_key, PACK_MOVE(best_move), alpha, depth, alpha > old_alpha ? TT_EXACT : TT_ALPHA, tt_generation);
+	return alpha;
+}
+
+static const u64 EVAL_KEY_MASK = ~0xffffULL;
+
+// Static evaluation of the current position, from the eval cache when the
+// position was evaluated before during this search.
+int SearchContext::evaluate()
+{
+	u64 key = board.position_key();
+	u64& entry = eval_cache[key & (EVAL_CACHE_ENTRIES - 1)];
+
+	if (entry != 0 && ((entry ^ key) & EVAL_KEY_MASK) == 0) {
+		info.eval_hits++;
+		return (int16_t)(entry & 0xffff);
+	}
+
+	info.eval_misses++;
+	int score = board.get_score();
+	entry = (key & EVAL_KEY_MASK) | (uint16_t)score;
+	return score;
+}
+
+void SearchContext::clear_for_search() {
+	info.stopped = false;
+	info.nodes = 0;
+	published_nodes.store(0, std::memory_order_relaxed);
+	info.depth = 1;
+	info.starttime = get_time_ms();
+
+	info.depth_done = 0;
+	info.best_move = 0;
+	info.fh = 0;
+	info.fhf = 0;
+	info.eval_hits = 0;
+	info.eval_misses = 0;
+	ply = 0;
+	pondering = polled_signals->ponder;
+
+	// Killers belong to the old position, history is only aged
+	memset(killers, 0, sizeof(killers));
+	for (int side = 0; side < 2; ++side)
+		for (int from = 0; from < 64; ++from)
+			for (int to = 0; to < 64; ++to)
+				history[side][from][to] /= 8;
+}
+
+// Search the root to depth inside an aspiration window around the score
+// the line had in the previous iteration. Outside the window the score is
+// only a bound, so the side that failed is widened by a growing margin and
+// the depth searched again.
+int SearchContext::aspiration_search(int depth, int previous_score) {
+	int alpha = -INF;
+	int beta = INF;
+	int delta = ASPIRATION_WINDOW;
+
+	if (depth > ASPIRATION_DEPTH) {
+		alpha = std::max(previous_score - delta, -INF);
+		beta = std::min(previous_score + delta, INF);
+	}
+
+	while (true) {
+		root_move = 0;
+		int score = alpha_beta(alpha, beta, depth, true);
+		if (info.stopped) return score;
+
+		if (score <= alpha && alpha > -INF) {
+			alpha = std::max(alpha - delta, -INF);
+			delta *= 2;
+		}
+		else if (score >= beta && beta < INF) {
+			beta = std::min(beta + delta, INF);
+			delta *= 2;
+		}
+		else {
+			return score;
+		}
+	}
+}
+
+int SearchContext::search() {
+	clear_for_search();
+
+	int best_move = 0;
+	int previous_best = 0;
+	int stability = 0;
+
+	// Every line after the first searches the root without the moves of
+	// the lines before it, so there can't be more lines than root moves.
+	S_MOVELIST root_moves;
+	board.generate_moves(root_moves);
+	int lines = std::max(1, std::min(multipv, root_moves.count));
+
+	int line_scores[MAX_MULTIPV];
+	for (int i = 0; i < lines; ++i) line_scores[i] = -INF;
+
+	// Lazy SMP helpers on odd threads start a ply deeper, so the threads
+	// spread over neighbouring depths rather than all searching the same.
+	if (info.thread_id & 1) info.depth++;
+
+	S_PVLINE pv_lines[MAX_MULTIPV];
+
+	while (true) {
+		if (info.stopped || info.depth > info.depthset) break;
+
+		excluded_count = 0;
+
+		int done = 0;
+		for (; done < lines; ++done) {
+			int score = aspiration_search(info.depth, line_scores[done]);
+			if (info.stopped) break;
+
+			// The root move comes from the search itself, as the hash entry
+			// of the root may since have been overwritten by another thread.
+			S_PVLINE& line = pv_lines[done];
+			line.score = score;
+			line.length = get_pv_line(info.depth, root_move);
+			memcpy(line.moves, pv_array, sizeof(int) * std::max(1, line.length));
+			excluded[excluded_count++] = line.moves[0];
+		}
+
+		excluded_count = 0;
+		if (done == 0) break;
+
+		// A later line can come out ahead of an earlier one, so the lines
+		// are reported best first and the best is played.
+		std::stable_sort(pv_lines, pv_lines + done, [](const S_PVLINE& a, const S_PVLINE& b) {
+			return a.score > b.score;
+		});
+		for (int i = 0; i < done; ++i) line_scores[i] = pv_lines[i].score;
+
+		best_move = pv_lines[0].moves[0];
+		info.depth_done = info.depth;
+		info.best_move = best_move;
+
+		// Only the main thread reports
+		if (info.thread_id == 0) {
+			for (int i = 0; i < done; ++i) {
+				std::ostringstream line;
+				line << "info depth " << info.depth << " multipv " << i + 1 << " score cp " << pv_lines[i].score << " time " << get_time_ms() - info.starttime << " nodes " << total_nodes() << " hashfull " << table->hashfull(tt_generation);
+
+				line << " pv";
+				for (int pv_num = 0; pv_num < pv_lines[i].length; ++pv_num)
+				{
+					line << " " << board.get_move_ref(pv_lines[i].moves[pv_num]);
+				}
+				send_line(line.str());
+			}
+		}
+
+		if (info.stopped) break;
+
+		if (info.thread_id != 0) {
+			info.depth++;
+			continue;
+		}
+
+		// Share of cutoffs made by the first move searched, and how the
+		// eval cache is doing
+		if (info.fh > 0) {
+			std::ostringstream ordering;
+			ordering << "info string ordering " << std::fixed << std::setprecision(2) << info.fhf / info.fh
+				<< " evalhits " << info.eval_hits << " evalmisses " << info.eval_misses;
+			send_line(ordering.str());
+		}
+
+		// Don't start an iteration that is unlikely to finish in time. A
+		// best move that has held for several iterations lets the search
+		// stop early, one that just changed earns it some extra time.
+		stability = best_move == previous_best ? stability + 1 : 0;
+		previous_best = best_move;
+
+		double scale = stability >= 4 ? 0.4 : stability >= 2 ? 0.7 : stability == 0 && info.depth > 1 ? 1.2 : 1.0;
+		if (!is_pondering() && get_time_ms() - info.starttime > info.softtime * scale) break;
+
+		info.depth++;
+	}
+
+	// Stopped before the first iteration finished: take the hash move, or
+	// failing that any legal move.
+	if (best_move == 0 && get_pv_line(1) > 0) best_move = pv_array[0];
+	if (best_move == 0 && root_moves.count > 0) best_move = root_moves.moves[0].move;
+
+	return best_move;
+}
+
+int SearchContext::get_pv_line(int depth, int first_move)
+{
+	int count = 0;
+	TT_ENTRY entry;
+	pv_array[0] = 0;
+
+	if (first_move != 0) {
+		board.make_move(first_move);
+		pv_array[count++] = first_move;
+	}
+
+	while (count < depth && table->probe(board.position_key(), entry, tt_generation))
+	{
+		int move = board.expand_move(entry.move);
+		if (move == 0) break;
+
+		board.make_move(move);
+		pv_array[count++] = move;
+	}
+
+	for (int i = 0; i < count; ++i) board.undo_last_move();
+	return count;
+}
+
+int SearchContext::ponder_move(int best_move)
+{
+	if (best_move == 0) return 0;
+
+	board.make_move(best_move);
+	TT_ENTRY entry;
+	int reply = table->probe(board.position_key(), entry, tt_generation) ? board.expand_move(entry.move) : 0;
+	board.undo_last_move();
+
+	return reply;
+}
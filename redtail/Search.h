@@ -0,0 +1,152 @@
+#include <string>
+#include <vector>
+#include <atomic>
+#include "Board.h"
+#include "TTable.h"
+#pragma once
+
+// Most lines a MultiPV search reports
+const int MAX_MULTIPV = 64;
+
+// Entries in each search's eval cache, a power of two
+const int EVAL_CACHE_ENTRIES = 1 << 14;
+
+// Search parameters that can be tuned through UCI options
+typedef struct {
+    int lmr_base;        // Reduction offset, in hundredths of a ply
+    int lmr_divisor;     // Divisor of log(depth) * log(moves), in hundredths
+    int lmr_min_moves;   // Moves searched in full before reducing
+    int futility_margin; // Per ply of depth left, in centipawns
+    int futility_depth;  // Deepest node where quiet moves are pruned
+    int rfp_margin;      // Reverse futility margin per ply, in centipawns
+    int rfp_depth;       // Deepest node cut by reverse futility
+} S_SEARCHPARAMS;
+
+extern S_SEARCHPARAMS search_params;
+
+// Fill the late move reduction table from the current parameters
+void init_reductions();
+
+// Print every parameter as a UCI spin option
+void print_search_options();
+
+// Set the parameter behind a UCI option, false for an unknown name
+bool set_search_option(const std::string& name, int value);
+
+// Milliseconds on a monotonic clock
+int get_time_ms();
+
+// Split the remaining clock time into a soft and a hard limit for this
+// move, given the increment and the moves left until the next time
+// control (0 if unknown).
+void allocate_time(S_SEARCHINFO& info, int time, int inc, int movestogo);
+
+// Flags raised from another thread to end or release a search. A search
+// and its helper threads share one set, so stopping one game's search
+// leaves any other running.
+typedef struct {
+    // Raised by the UCI 'stop' command, and by the main search thread once
+    // it finishes so the helpers stop too. Whoever starts a search lowers
+    // it first.
+    std::atomic<bool> stop;
+
+    // Raised by 'go ponder' and lowered by 'ponderhit' or 'stop'. While it
+    // is up the search ignores its time limits and holds back its move.
+    std::atomic<bool> ponder;
+} S_SEARCHSIGNALS;
+
+// A Lazy SMP helper thread's position and search state, see Threads.cpp
+struct Helper;
+
+// Everything one game's search needs besides the position: limits and
+// statistics, the distance from the root and the principal variation.
+// The position stays in the Board and the lookup tables besides the eval
+// cache are process-wide. Stop and ponder flags and helper threads belong
+// to the context, so any number of games can be searched side by side,
+// sharing only the transposition table.
+class SearchContext
+{
+public:
+    SearchContext(Board& board);
+    ~SearchContext();
+
+    Board& board;
+    S_SEARCHINFO info;
+
+    // Plies from the root of the current search
+    int ply;
+
+    // The context's own flags, and the ones check_up polls: the same, or
+    // for a helper those of the search it helps.
+    S_SEARCHSIGNALS signals;
+    S_SEARCHSIGNALS* polled_signals;
+
+    // Transposition table searched with, TT unless set otherwise, and the
+    // generation this context's entries are written in. smp_search moves
+    // to a new generation for every search.
+    TranspositionTable* table;
+    uint8_t tt_generation;
+
+    // Helper threads smp_search starts alongside this context
+    std::vector<Helper*> helpers;
+
+    // info.nodes as last published by check_up, for other threads to read
+    // while this context searches
+    std::atomic<u64> published_nodes;
+
+    // Nodes searched so far by this context and its helpers together
+    u64 total_nodes();
+
+    // Searching on the opponent's time, see is_pondering
+    bool pondering;
+    bool is_pondering();
+
+    int pv_array[Board::MAX_DEPTH];
+
+    // Number of best root moves to report each with its own line, and the
+    // root moves the line being searched has to leave out
+    int multipv;
+    int excluded[MAX_MULTIPV];
+    int excluded_count;
+
+    // Best root move of the last call to alpha_beta at the root, 0 if no
+    // move raised alpha
+    int root_move;
+
+    // Quiet move ordering, learnt from beta cutoffs: two killer moves per
+    // ply, butterfly history by side, from and to, and the reply that
+    // refuted each move, indexed by that move's piece and destination.
+    int killers[Board::MAX_DEPTH][2];
+    int history[2][64][64];
+    int countermoves[12][64];
+
+    // Static evaluations by position key, direct-mapped: the key's upper
+    // 48 bits with the score in the low 16. Kept from one search to the
+    // next, so whoever changes the evaluation has to call clear_eval_cache.
+    std::vector<u64> eval_cache;
+    int evaluate();
+
+    // Empties the eval cache of this context and its helpers
+    void clear_eval_cache();
+
+    void score_quiets(S_MOVELIST& list);
+    void update_quiet_stats(int move, int depth);
+
+    // Iterative deepening up to info.depthset or info.timeset, returns the
+    // best move found.
+    int search();
+    int aspiration_search(int depth, int previous_score);
+    int alpha_beta(int alpha, int beta, int depth, bool do_null);
+    int quiesce(int alpha, int beta);
+    void clear_for_search();
+
+    // Stop the search once its time is up or a stop was requested
+    void check_up();
+
+    // Follow the hash moves from the current position into pv_array,
+    // after first_move when one is given. Returns the number of moves.
+    int get_pv_line(int depth, int first_move = 0);
+
+    // Expected reply to best_move, from the hash table, or 0
+    int ponder_move(int best_move);
+};
@@ -0,0 +1,160 @@
+#include <cstdlib>
+#include "TTable.h"
+
+TranspositionTable TT;
+
+// The generation lives in the upper six bits of gen_bound
+static const int GENERATION_MASK = 0xfc;
+
+static_assert(sizeof(TT_BUCKET) == 64, "a bucket must fill one cache line");
+
+static u64 pack_entry(int move, int score, int depth, int gen_bound)
+{
+	return (u64)(uint16_t)move | ((u64)(uint16_t)score << 16) | ((u64)(uint8_t)depth << 32) | ((u64)(uint8_t)gen_bound << 40);
+}
+
+static TT_ENTRY unpack_entry(u64 data)
+{
+	TT_ENTRY entry;
+	entry.move = (uint16_t)data;
+	entry.score = (int16_t)(data >> 16);
+	entry.depth = (uint8_t)(data >> 32);
+	entry.gen_bound = (uint8_t)(data >> 40);
+	return entry;
+}
+
+TranspositionTable::TranspositionTable()
+{
+	memory = NULL;
+	buckets = NULL;
+	resize(TT_DEFAULT_MB);
+}
+
+TranspositionTable::~TranspositionTable()
+{
+	free(memory);
+}
+
+void TranspositionTable::resize(int mb)
+{
+	if (mb < 1) mb = 1;
+	if (mb > TT_MAX_MB) mb = TT_MAX_MB;
+
+	u64 count = 1;
+	while (count * 2 * sizeof(TT_BUCKET) <= (u64)mb * 1024 * 1024) count *= 2;
+
+	free(memory);
+
+	// Over-allocate so the buckets can start on a cache line boundary
+	memory = malloc(count * sizeof(TT_BUCKET) + 63);
+	buckets = (TT_BUCKET*)(((uintptr_t)memory + 63) & ~(uintptr_t)63);
+	mask = count - 1;
+
+	clear();
+}
+
+void TranspositionTable::clear()
+{
+	for (u64 i = 0; i <= mask; ++i)
+	{
+		for (int j = 0; j < TT_BUCKET_ENTRIES; ++j)
+		{
+			buckets[i].entries[j].check.store(0, std::memory_order_relaxed);
+			buckets[i].entries[j].data.store(0, std::memory_order_relaxed);
+		}
+	}
+}
+
+bool TranspositionTable::probe(u64 key, TT_ENTRY& entry, uint8_t generation)
+{
+	TT_BUCKET& bucket = buckets[key & mask];
+
+	for (int i = 0; i < TT_BUCKET_ENTRIES; ++i)
+	{
+		TT_SLOT& slot = bucket.entries[i];
+		u64 data = slot.data.load(std::memory_order_relaxed);
+		u64 check = slot.check.load(std::memory_order_relaxed);
+
+		if ((check ^ data) != key) continue;
+
+		entry = unpack_entry(data);
+		if (TT_BOUND(entry) == TT_NONE) continue;
+
+		// Still useful, so keep it from ageing out
+		if ((entry.gen_bound & GENERATION_MASK) != generation)
+		{
+			data = pack_entry(entry.move, entry.score, entry.depth, generation | TT_BOUND(entry));
+			slot.check.store(key ^ data, std::memory_order_relaxed);
+			slot.data.store(data, std::memory_order_relaxed);
+		}
+		return true;
+	}
+	return false;
+}
+
+// Overwrite the slot already holding this position if there is one, or
+// else the least valuable entry of the bucket: shallow entries left over
+// from earlier searches go first.
+void TranspositionTable::store(u64 key, int move, int score, int depth, int bound, uint8_t generation)
+{
+	TT_BUCKET& bucket = buckets[key & mask];
+
+	TT_SLOT* replace = &bucket.entries[0];
+	TT_ENTRY old = unpack_entry(replace->data.load(std::memory_order_relaxed));
+	bool same = false;
+	int replace_worth = 0x7fffffff;
+
+	for (int i = 0; i < TT_BUCKET_ENTRIES; ++i)
+	{
+		TT_SLOT& slot = bucket.entries[i];
+		u64 data = slot.data.load(std::memory_order_relaxed);
+		u64 check = slot.check.load(std::memory_order_relaxed);
+		TT_ENTRY e = unpack_entry(data);
+
+		if (TT_BOUND(e) == TT_NONE || (check ^ data) == key)
+		{
+			replace = &slot;
+			old = e;
+			same = TT_BOUND(e) != TT_NONE;
+			break;
+		}
+
+		int age = (uint8_t)(generation - (e.gen_bound & GENERATION_MASK)) / TT_GENERATION_STEP;
+		int worth = e.depth - 8 * age;
+		if (worth < replace_worth)
+		{
+			replace = &slot;
+			old = e;
+			replace_worth = worth;
+		}
+	}
+
+	// Don't let a shallow bound from this search wipe out a deeper result
+	// for the same position.
+	if (same && bound != TT_EXACT && depth + 2 < old.depth &&
+		(old.gen_bound & GENERATION_MASK) == generation) return;
+
+	// Keep the old move if the new search did not find one
+	if (!move && same) move = old.move;
+
+	u64 data = pack_entry(move, score, depth, generation | bound);
+	replace->check.store(key ^ data, std::memory_order_relaxed);
+	replace->data.store(data, std::memory_order_relaxed);
+}
+
+int TranspositionTable::hashfull(uint8_t generation)
+{
+	int used = 0;
+	int sample = 1000 / TT_BUCKET_ENTRIES;
+	if ((u64)sample > mask + 1) sample = (int)(mask + 1);
+
+	for (int i = 0; i < sample; ++i)
+	{
+		for (int j = 0; j < TT_BUCKET_ENTRIES; ++j)
+		{
+			TT_ENTRY e = unpack_entry(buckets[i].entries[j].data.load(std::memory_order_relaxed));
+			if (TT_BOUND(e) != TT_NONE && (e.gen_bound & GENERATION_MASK) == generation) ++used;
+		}
+	}
+	return used * 1000 / (sample * TT_BUCKET_ENTRIES);
+}
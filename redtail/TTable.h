@@ -0,0 +1,79 @@
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include "Bitboard.h"
+#pragma once
+
+// Bound stored with an entry. TT_NONE marks an empty slot.
+enum {
+    TT_NONE,
+    TT_EXACT,
+    TT_ALPHA,
+    TT_BETA
+};
+
+// What an entry holds: the move in packed 16-bit form, the score, the
+// depth searched and the generation it was written in, with the bound in
+// the low two bits of gen_bound.
+typedef struct {
+    uint16_t move;
+    int16_t score;
+    uint8_t depth;
+    uint8_t gen_bound;
+} TT_ENTRY;
+
+#define TT_BOUND(e) ((e).gen_bound & 3)
+
+// An entry as stored: the fields above packed into data, and the position
+// key XORed with data. Every search thread reads and writes the table
+// without locking, so a slot caught halfway through another thread's
+// write simply fails to match its key.
+typedef struct {
+    std::atomic<u64> check;
+    std::atomic<u64> data;
+} TT_SLOT;
+
+const int TT_BUCKET_ENTRIES = 4;
+
+// A bucket fills exactly one cache line, so a probe touches one line.
+typedef struct {
+    TT_SLOT entries[TT_BUCKET_ENTRIES];
+} TT_BUCKET;
+
+// Entries carry the generation of the search that last wrote or read them,
+// and older generations are replaced first. The generation belongs to the
+// caller, not the table: each SearchContext keeps its own and advances it
+// by TT_GENERATION_STEP for every search, so games searching side by side
+// never age each other's entries.
+const int TT_GENERATION_STEP = 4;
+
+// Size of the table in MB when no Hash option is given
+const int TT_DEFAULT_MB = 16;
+const int TT_MAX_MB = 65536;
+
+class TranspositionTable
+{
+private:
+    void* memory;
+    TT_BUCKET* buckets;
+    u64 mask;
+
+public:
+    TranspositionTable();
+    ~TranspositionTable();
+
+    // Reallocate to the largest power-of-two number of buckets fitting in
+    // mb megabytes. The contents are lost. Neither may be called while
+    // another thread is searching with the table.
+    void resize(int mb);
+    void clear();
+
+    bool probe(u64 key, TT_ENTRY& entry, uint8_t generation);
+    void store(u64 key, int move, int score, int depth, int bound, uint8_t generation);
+
+    // Permille of the table written in the given generation
+    int hashfull(uint8_t generation);
+};
+
+// The table every search context uses unless given its own
+extern TranspositionTable TT;
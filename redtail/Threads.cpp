@@ -0,0 +1,109 @@
+#include <thread>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include "Threads.h"
+#include "TTable.h"
+
+// A helper thread's own position and search state, kept between searches
+struct Helper
+{
+	Board board;
+	SearchContext context;
+
+	Helper() : context(board) {}
+};
+
+void set_search_threads(SearchContext& context, int count)
+{
+	std::vector<Helper*>& helpers = context.helpers;
+
+	if (count < 1) count = 1;
+	if (count > MAX_THREADS) count = MAX_THREADS;
+
+	while ((int)helpers.size() > count - 1)
+	{
+		delete helpers.back();
+		helpers.pop_back();
+	}
+	while ((int)helpers.size() < count - 1)
+	{
+		Helper* helper = new Helper();
+		helper->context.polled_signals = &context.signals;
+		helpers.push_back(helper);
+	}
+}
+
+// Helpers are still counting while this is read, so their counts can be
+// up to CHECK_INTERVAL nodes behind.
+u64 SearchContext::total_nodes()
+{
+	u64 nodes = info.nodes;
+	for (Helper* helper : helpers) nodes += helper->context.published_nodes.load(std::memory_order_relaxed);
+	return nodes;
+}
+
+void SearchContext::clear_eval_cache()
+{
+	std::fill(eval_cache.begin(), eval_cache.end(), 0ULL);
+	for (Helper* helper : helpers) helper->context.clear_eval_cache();
+}
+
+// Helpers are only known complete here, so the context is torn down here
+SearchContext::~SearchContext()
+{
+	set_search_threads(*this, 1);
+}
+
+int smp_search(SearchContext& context)
+{
+	S_BOARD_STATE root;
+	context.board.save_state(root);
+
+	// Entries this game wrote before now count as older, other games'
+	// entries are left alone.
+	context.tt_generation += TT_GENERATION_STEP;
+
+	std::vector<std::thread> pool;
+	std::vector<Helper*>& helpers = context.helpers;
+	for (size_t i = 0; i < helpers.size(); ++i)
+	{
+		SearchContext* helper = &helpers[i]->context;
+		helper->board.restore_state(root);
+		helper->info.timeset = context.info.timeset;
+		helper->info.softtime = context.info.softtime;
+		helper->info.depthset = context.info.depthset;
+		helper->info.nodeset = context.info.nodeset;
+		helper->info.thread_id = (int)i + 1;
+		helper->table = context.table;
+		helper->tt_generation = context.tt_generation;
+
+		pool.push_back(std::thread([helper]() { helper->search(); }));
+	}
+
+	context.info.thread_id = 0;
+	int best_move = context.search();
+
+	// A ponder search must not answer before ponderhit or stop, even if it
+	// has nothing left to search.
+	S_SEARCHSIGNALS& signals = context.signals;
+	while (signals.ponder && !signals.stop) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+	signals.stop = true;
+	for (std::thread& thread : pool) thread.join();
+
+	// A helper that completed a deeper iteration than the main thread has
+	// the more reliable move.
+	int best_depth = context.info.depth_done;
+	for (Helper* helper : helpers)
+	{
+		S_SEARCHINFO& info = helper->context.info;
+		if (info.depth_done > best_depth && info.best_move != 0)
+		{
+			best_depth = info.depth_done;
+			best_move = info.best_move;
+		}
+	}
+
+	return best_move;
+}
@@ -0,0 +1,16 @@
+#include <atomic>
+#include "Search.h"
+#pragma once
+
+const int MAX_THREADS = 256;
+
+// Set the number of threads searching with context, the thread calling
+// smp_search included.
+void set_search_threads(SearchContext& context, int count);
+
+// Lazy SMP: the main thread searches with context while each of its helpers
+// searches its own copy of the position, all sharing the transposition
+// table so each thread profits from what the others have already searched.
+// The result of whichever thread completed the deepest iteration is
+// returned.
+int smp_search(SearchContext& context);
@@ -1,7 +1,38 @@
 #include "Board.h"
+#include "Perft.h"
+#include "Bench.h"
+#include "Search.h"
+#include "TTable.h"
+#include "Threads.h"
+#include "Nnue.h"
 #include <iostream>
 #include "Utils.h"
 #include <thread>
+#include <climits>
+#include <algorithm>
+#include <cstdlib>
+#include <cstdint>
+
+// Parse the whole of text as a decimal number, false if it is anything
+// else. Numbers out of range are clamped.
+static bool parse_int64(const std::string& text, int64_t& value)
+{
+	char* end;
+	long long parsed = strtoll(text.c_str(), &end, 10);
+	if (text.empty() || *end != '\0') return false;
+
+	value = parsed;
+	return true;
+}
+
+static bool parse_int(const std::string& text, int& value)
+{
+	int64_t parsed;
+	if (!parse_int64(text, parsed)) return false;
+
+	value = (int)std::max((int64_t)INT_MIN, std::min(parsed, (int64_t)INT_MAX));
+	return true;
+}
 
 int parse_uci_move(std::string uci_move, Board *board)
 {
@@ -14,24 +45,63 @@ int parse_uci_move(std::string uci_move, Board *board)
 	int target_row = FILES.find(uci_move[2]);
 	int target_col = RANKS.find(uci_move[3]);
 
-	int from_pos = (16 * (7 - from_col)) + from_row;
-	int target_pos = (16 * (7 - target_col)) + target_row;
+	int from_pos = (8 * (7 - from_col)) + from_row;
+	int target_pos = (8 * (7 - target_col)) + target_row;
 
+	int promoted = WhitePawn;
 	if (uci_move.size() == 5)
 	{
-		if (uci_move[4] == 'q') board->squares[from_pos] = board->turn == White ? WhiteQueen : BlackQueen;
-		if (uci_move[4] == 'b') board->squares[from_pos] = board->turn == White ? WhiteQueen : BlackQueen;
-		if (uci_move[4] == 'n') board->squares[from_pos] = board->turn == White ? WhiteQueen : BlackQueen;
-		if (uci_move[4] == 'r') board->squares[from_pos] = board->turn == White ? WhiteQueen : BlackQueen;
+		promoted = std::string("pnbrq").find(uci_move[4]);
+		if (board->turn == Black) promoted += BlackPawn;
 	}
 
-	int move = (from_pos << 20) | (target_pos << 12) | (board->squares[from_pos] << 8) | (board->squares[target_pos] << 4) | 0;
+	// Look the move up among the legal moves so castling, en passant and
+	// promotion flags are filled in. Returns 0 for an illegal move.
+	return board->find_move(from_pos, target_pos, promoted);
+}
+
+// Set the search limits from the arguments of a go command. With no limit
+// given at all the search gets five seconds. Values that don't parse are
+// ignored.
+void parse_go(const std::vector<std::string>& comms, SearchContext& search)
+{
+	int time = -1, inc = 0, movestogo = 0, movetime = -1, depth = 0;
+	int64_t nodes = 0;
+	bool infinite = false;
+
+	S_SEARCHINFO& info = search.info;
+	info.depthset = Board::MAX_DEPTH;
+	info.nodeset = 0;
 
-	return move;
+	for (size_t i = 1; i < comms.size(); ++i)
+	{
+		const std::string& arg = comms[i];
+		bool has_value = i + 1 < comms.size();
+
+		if (arg == "infinite") infinite = true;
+		else if (!has_value) break;
+		else if (arg == (search.board.turn == White ? "wtime" : "btime")) parse_int(comms[++i], time);
+		else if (arg == (search.board.turn == White ? "winc" : "binc")) parse_int(comms[++i], inc);
+		else if (arg == "movestogo") parse_int(comms[++i], movestogo);
+		else if (arg == "movetime") parse_int(comms[++i], movetime);
+		else if (arg == "depth" && parse_int(comms[++i], depth) && depth > 0) info.depthset = std::min(depth, (int)Board::MAX_DEPTH);
+		else if (arg == "nodes" && parse_int64(comms[++i], nodes) && nodes > 0) info.nodeset = (u64)nodes;
+	}
+
+	search.signals.ponder = std::find(comms.begin(), comms.end(), "ponder") != comms.end();
+
+	bool limited = time >= 0 || movetime >= 0 || info.depthset != Board::MAX_DEPTH || info.nodeset != 0;
+
+	// A fixed move time is spent in full, so only the hard limit applies
+	info.timeset = info.softtime = INT_MAX;
+	if (movetime >= 0) info.timeset = movetime;
+	else if (time >= 0) allocate_time(info, time, inc, movestogo);
+	else if (!infinite && !limited) info.timeset = info.softtime = 5000;
 }
 
 int main() {
 	Board board = Board();
+	SearchContext search(board);
 	const std::string START_POS = "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
 	// const std::string START_POS = "rnbqkb2/p1pp1p1p/1p2p2n/6Q1/2BPP3/8/PPP2PPP/RN2K1NR b KQq - 0 8";
 	board.set_fen(START_POS);
@@ -46,23 +116,77 @@ int main() {
 		<< "id country South Africa\n"
 		<< "uciok\n";
 
+	// Searches run here while this thread keeps reading commands, so
+	// isready and stop are answered during a search.
+	std::thread search_thread;
+	auto wait_for_search = [&]() {
+		if (search_thread.joinable()) search_thread.join();
+	};
+
 	for (;;)
 	{
 		std::string comm;
-		std::getline(std::cin, comm);
+		if (!std::getline(std::cin, comm)) comm = "quit";
 
 		std::vector<std::string> comms = split(comm, ' ');
 
+		// Every other command has to wait for a running search to finish
+		if (comm != "isready" && comm != "stop" && comm != "quit" && comm != "ponderhit") wait_for_search();
+
 		if (comm == "isready")
 		{
-			std::cout << "readyok" << std::endl;
+			send_line("readyok");
 		}
 
 		else if (comm == "uci")
 		{
+			std::cout << "option name Hash type spin default " << TT_DEFAULT_MB << " min 1 max " << TT_MAX_MB << std::endl;
+			std::cout << "option name Threads type spin default 1 min 1 max " << MAX_THREADS << std::endl;
+			std::cout << "option name Ponder type check default false" << std::endl;
+			std::cout << "option name MultiPV type spin default 1 min 1 max " << MAX_MULTIPV << std::endl;
+			std::cout << "option name EvalFile type string default <empty>" << std::endl;
+			print_search_options();
 			std::cout << "uciok" << std::endl;
 		}
 
+		else if (comm == "ucinewgame")
+		{
+			// The table may be shared with other games, so it is not
+			// cleared: the last game's entries age out and get replaced.
+			search.tt_generation += TT_GENERATION_STEP;
+		}
+
+		// setoption name <id> [value <x>], where both may contain spaces.
+		// Options we don't know, or values that don't parse, are ignored.
+		else if (comms[0] == "setoption")
+		{
+			std::string name, value;
+			size_t i = 2;
+			for (; i < comms.size() && comms[i] != "value"; ++i) name += (name.empty() ? "" : " ") + comms[i];
+			for (++i; i < comms.size(); ++i) value += (value.empty() ? "" : " ") + comms[i];
+
+			int number = 0;
+			bool numeric = parse_int(value, number);
+			bool known = true;
+
+			if (name == "Ponder") {} // Only tells us the GUI may send go ponder
+			else if (name == "EvalFile")
+			{
+				if (value == "<empty>" || value.empty()) nnue_unload();
+				else if (nnue_load(value)) send_line("info string loaded EvalFile " + value);
+				else send_line("info string could not load EvalFile " + value);
+				board.refresh_accumulator();
+				search.clear_eval_cache();
+			}
+			else if (!numeric) known = false;
+			else if (name == "Hash") TT.resize(number);
+			else if (name == "Threads") set_search_threads(search, number);
+			else if (name == "MultiPV") search.multipv = std::max(1, std::min(number, MAX_MULTIPV));
+			else known = set_search_option(name, number);
+
+			if (!known) send_line("info string ignoring option " + name);
+		}
+
 		else if (comms[0] == "position")
 		{
 			std::string position = comms[1];
@@ -72,7 +196,7 @@ int main() {
 				board.set_fen(START_POS);
 
 				// Series of moves from the initial starting position
-				if (comms[2] == "moves")
+				if (comms.size() > 2 && comms[2] == "moves")
 				{
 					for (int i = 3; i < comms.size(); ++i)
 					{
@@ -81,8 +205,8 @@ int main() {
 						if (uci_move.size() < 4) continue;
 
 						int move = parse_uci_move(uci_move, &board);
+						if (move == 0) break;
 
-						board.store_pv_move(move);
 						board.make_move(move);
 					}
 				}
@@ -109,14 +233,40 @@ int main() {
 			}
 		}
 
-		else if (comms[0] == "go" || comms[0] == "stop")
+		// go [wtime <x>] [btime <x>] [winc <x>] [binc <x>] [movestogo <x>]
+		// [movetime <x>] [depth <x>] [nodes <x>] [infinite]
+		else if (comms[0] == "go")
+		{
+			parse_go(comms, search);
+
+			search.signals.stop = false;
+			search_thread = std::thread([&]() {
+				int move = smp_search(search);
+				int reply = search.ponder_move(move);
+				// Mated or stalemated, there is no move to play
+				if (move == 0) send_line("bestmove 0000");
+				else send_line("bestmove " + board.get_move_ref(move) + (reply ? " ponder " + board.get_move_ref(reply) : ""));
+			});
+		}
+
+		else if (comm == "stop")
 		{
-			int move = board.search();
-			std::cout << "bestmove " << board.get_move_ref(move) << std::endl;
+			search.signals.ponder = false;
+			search.signals.stop = true;
+		}
+
+		// The opponent played the move we were pondering on, carry on
+		// searching with the clock running
+		else if (comm == "ponderhit")
+		{
+			search.signals.ponder = false;
 		}
 
 		else if (comm == "quit")
 		{
+			search.signals.ponder = false;
+			search.signals.stop = true;
+			wait_for_search();
 			break;
 		}
 
@@ -129,26 +279,52 @@ int main() {
 
 		else if (comm == "listmoves")
 		{
-			std::vector<S_MOVE> moves = board.ordered_moves();
+			S_MOVELIST list;
+			board.ordered_moves(list);
 
-			for (S_MOVE move : moves)
+			for (int i = 0; i < list.count; ++i)
 			{
+				S_MOVE move = list.moves[i];
 				board.make_move(move.move);
 
 				// S_SEARCHINFO search_info;
 				// board.clear_for_search(&search_info);
 
 				// std::cout << board.get_move_ref(move.move) << " " << board.get_score() << " " << board.alpha_beta(-999999999, 999999999, 0) << std::endl;
-				std::cout << board.get_move_ref(move.move) << " " << move.score << " " << floor(((move.move >> 12) & 0xff) / 16) << std::endl;
+				std::cout << board.get_move_ref(move.move) << " " << move.score << " " << ROW_OF(TO_SQ(move.move)) << std::endl;
 				board.undo_last_move();
 			}
 		}
 
-		else if (comm == "perft")
+		// bench [depth], searches a fixed set of positions and prints the
+		// total node count
+		else if (comms[0] == "bench")
+		{
+			int depth = BENCH_DEPTH;
+			if (comms.size() > 1) parse_int(comms[1], depth);
+			bench(depth);
+		}
+
+		// perft [depth] [threads], the depth is read from the next line
+		// when it is not given
+		else if (comms[0] == "perft")
+		{
+			int depth = 0;
+			if (comms.size() > 1) parse_int(comms[1], depth);
+			else std::cin >> depth;
+
+			int threads = (int)std::thread::hardware_concurrency();
+			if (comms.size() > 2) parse_int(comms[2], threads);
+			perft_divide(board, depth, threads);
+		}
+
+		// Single threaded copy-make perft, to compare against make/unmake
+		else if (comms[0] == "perftcopy")
 		{
-			int depth;
-			std::cin >> depth;
-			std::cout << board.perft(depth) << std::endl;
+			int depth = 0;
+			if (comms.size() > 1) parse_int(comms[1], depth);
+			else std::cin >> depth;
+			std::cout << board.perft_copy(depth) << std::endl;
 		}
 
 		else if (comm == "t")
@@ -162,8 +338,8 @@ int main() {
 			std::string uci_move;
 			std::cin >> uci_move;
 			int move = parse_uci_move(uci_move, &board);
+			if (move == 0) continue;
 
-			board.store_pv_move(move);
 			board.make_move(move);
 			board.draw();
 
@@ -172,11 +348,11 @@ int main() {
 
 		else if (comm == "pv")
 		{
-			int pv_moves = board.get_pv_line(counter);
+			int pv_moves = search.get_pv_line(counter);
 			printf("pv (%d) ", pv_moves);
 			for (int pv_num = 0; pv_num < pv_moves; ++pv_num)
 			{
-				printf(" %s", board.get_move_ref(board.pv_array[pv_num]).c_str());
+				printf(" %s", board.get_move_ref(search.pv_array[pv_num]).c_str());
 			}
 			printf("\n");
 		}
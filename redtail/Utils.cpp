@@ -1,5 +1,7 @@
 #include <vector>
 #include <string>
+#include <iostream>
+#include <mutex>
 #include "Utils.h"
 #pragma once
 
@@ -17,3 +19,10 @@ std::vector<std::string> split(const std::string &text, char sep)
 	tokens.push_back(text.substr(start));
 	return tokens;
 }
+
+void send_line(const std::string& line)
+{
+	static std::mutex output_mutex;
+	std::lock_guard<std::mutex> lock(output_mutex);
+	std::cout << line << std::endl;
+}
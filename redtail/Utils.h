@@ -3,3 +3,7 @@
 #pragma once
 
 std::vector<std::string> split(const std::string& text, char sep);
+
+// Write a whole line to stdout at once, so lines from the search thread
+// and the input thread never interleave.
+void send_line(const std::string& line);